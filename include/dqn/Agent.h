@@ -19,22 +19,39 @@
 #include <random>
 #include <map>
 #include <fstream>
+#include <chrono>
+#include <limits>
 
 #include "mlp-cpp/network.h"
+#include "mlp-cpp/checkpoint.h"
+#include "mlp-cpp/static_network.h"
+#include "mlp-cpp/quantized_network.h"
 #include "mlp-cpp/funcs.h"
 
 #include "utils/utils.h"
 #include "utils/rand_helper.h"
+#include "utils/metrics.h"
+#include "utils/env_pool.h"
+#include "utils/eval_cache.h"
+#include "utils/feature_cache.h"
 
-#include "BufferItem.h"
+#include "ReplayBuffer.h"
 
 #define NOP (std::string)""
 
-#define GRADIENT_MONITOR_FILENAME "data/training/train_gradient.txt"
+#define METRICS_LOG_FILENAME "data/training/train_metrics.bin"
 #define DEFAULT_WEIGHT_SAVE_LOCATION "data/training/weights_saved.txt"
+#define DEFAULT_CHECKPOINT_LOCATION "data/training/weights_saved.ckpt"
 #define DEFAULT_AGENT_INFO_LOCATION "data/training/agent_info.txt"
+#define DEFAULT_REPLAY_LOCATION "data/training/replay_buffer.bin"
 
 #define DEFAULT_SAVE_PERIOD 100
+#define DEFAULT_BATCH_SIZE 1
+#define DEFAULT_PRECISION AGENT_PRECISION_DOUBLE
+#define DEFAULT_NUM_THREADS 0 /* 0 trains single threaded, see MLP::set_num_threads */
+#define DEFAULT_REPLAY_SAMPLING REPLAY_SAMPLING_UNIFORM
+#define DEFAULT_OFFLINE_REPORT_PERIOD 1000 /* offline updates between q-value reports */
+#define DEFAULT_Q_STATS_BATCH 256 /* transitions per forward pass when computing q-value statistics */
 
 /* Change here to update default weight initialisation, loss , and reward functions used within Agent. */
 #define DEFAULT_INITIALISOR he_normal_initialiser
@@ -42,8 +59,52 @@
 #define DEFAULT_REWARD_FUNCTION relative_change_reward
 
 /* Change here to update default activation functions used within Agent */
-#define DEFAULT_HIDDEN_ACTIVATION mlp_ReLU
-#define DEFAULT_OUTPUT_ACTIVATION mlp_linear
+#define DEFAULT_HIDDEN_ACTIVATION MLP_ACTIVATION_RELU
+#define DEFAULT_OUTPUT_ACTIVATION MLP_ACTIVATION_LINEAR
+
+
+/* PRECISION MODES */
+
+/**
+ * @brief Scalar type used by the Q and Q_hat networks during training.
+ */
+enum agent_precision_t
+{
+    AGENT_PRECISION_DOUBLE, /* Q and Q_hat in double */
+    AGENT_PRECISION_FLOAT, /* Q and Q_hat in float */
+    AGENT_PRECISION_MIXED /* Q trained in float, Q_hat and target computation kept in double */
+};
+
+
+/* RANDOM STREAMS */
+
+/**
+ * @brief Independent sub streams of the Agent's rand_helper, so e.g. changing the batch size does not change which
+ * actions are explored or which programs are chosen.
+ */
+enum agent_stream_t
+{
+    AGENT_STREAM_NETWORKS, /* weight initialisation */
+    AGENT_STREAM_EXPLORATION, /* epsilon greedy */
+    AGENT_STREAM_SAMPLING, /* minibatch sampling from the replay buffer */
+    AGENT_STREAM_ENVIRONMENT /* program selection */
+};
+
+
+/* Q-VALUE STATISTICS */
+
+/**
+ * @brief Statistics of Q over every transition in the replay buffer, see Agent::q_value_stats.
+ */
+struct q_value_stats_t
+{
+    unsigned int num_transitions;
+    double mean_max_q; /* mean over states of the best action value */
+    double mean_action_q; /* mean value of the action taken in each transition */
+    double min_q;
+    double max_q;
+    double mean_abs_td_error; /* mean |y - Q(s, a)| with targets from Q_hat */
+};
 
 
 /* HELPER FUNCTIONS */
@@ -68,12 +129,29 @@ class Agent
 {
 private:
 
-    /* NETWORKS */
+    /* NETWORKS - only those used by the chosen precision are constructed, others are NULL */
     MLP* Q;
     MLP* Q_hat;
+    MLPf* Q_f;
+    MLPf* Q_hat_f;
+
+    agent_precision_t precision;
+    mlp_optimiser_t optimiser; /* used to train Q, Q_hat is only ever copied into */
+    std::vector<int> network_config;
 
     /* REPLAY BUFFER */
-    std::vector<BufferItem*> buff;
+    ReplayBuffer* buff;
+    replay_sampling_t replay_sampling;
+    std::string replay_filename; /* replay store kept between runs, empty for an in memory buffer */
+    replay_state_format_t replay_state_format;
+
+    /* MEASURED RUNTIMES - shared with other runs and optimisers through eval_cache_filename */
+    EvalCache* eval_cache;
+    std::string eval_cache_filename;
+
+    /* EXTRACTED PROGRAM STATES - in memory, and in feature_cache_filename when it is given */
+    FeatureCache* feature_cache;
+    std::string feature_cache_filename;
 
     /* STARTING ACTION SPACE */
     std::vector<std::string> actions;
@@ -91,6 +169,8 @@ private:
     unsigned int episode_length;
     double discount_rate;
     double learning_rate;
+    unsigned int batch_size;
+    unsigned int num_threads;
 
     /* PRIVATE VALUES */
 
@@ -103,15 +183,36 @@ private:
     // optimisation baseline for construction of environment and working with action spaces
     std::string optimisation_baseline;
 
-    // to place transition correctly in buffer
-    unsigned int curr_buff_pos; 
-
     /* RANDOM HELPER */
     rand_helper* rnd;
 
+    // sub streams of rnd, see agent_stream_t
+    rand_helper* exploration_rnd;
+    rand_helper* sampling_rnd;
+    rand_helper* environment_rnd;
+
+    /* BACKGROUND CHECKPOINT WRITER */
+    CheckpointWriter* checkpoint_writer;
+
     /* GRADIENT MONITORING */
     bool gradient_monitoring;
-    std::ofstream grad_monitor_file;
+
+    // training telemetry, written to METRICS_LOG_FILENAME in the background when gradient_monitoring is on
+    MetricsSink* metrics;
+    int loss_metric;
+    int init_runtime_metric;
+    int runtime_metric;
+    int reward_metric;
+
+    int mean_max_q_metric;
+    int mean_action_q_metric;
+    int td_error_metric;
+
+    // x axis of the recorded metrics
+    unsigned long train_step;
+
+    // train_step at which the current training run ends, prioritised replay anneals beta over the run
+    unsigned long planned_train_steps;
 
 
 public:
@@ -127,32 +228,77 @@ public:
         const double discount_rate,
         const double learning_rate,
         rand_helper* rnd,
-        bool gradient_monitoring=false
+        bool gradient_monitoring=false,
+        const unsigned int batch_size=DEFAULT_BATCH_SIZE,
+        const agent_precision_t precision=DEFAULT_PRECISION,
+        const mlp_optimiser_t optimiser=DEFAULT_OPTIMISER,
+        const unsigned int num_threads=DEFAULT_NUM_THREADS,
+        const replay_sampling_t replay_sampling=DEFAULT_REPLAY_SAMPLING,
+        const std::string& replay_filename=NOP,
+        const replay_state_format_t replay_state_format=DEFAULT_REPLAY_STATE_FORMAT,
+        const std::string& eval_cache_filename=DEFAULT_EVAL_CACHE_LOCATION,
+        const std::string& feature_cache_filename=NOP
     );
 
     ~Agent()
     {
-        // delete each buffer item
-        for(auto it = buff.begin(); it != buff.end(); ++it)
-            delete *it;
+        delete buff;
+        delete eval_cache;
+        delete feature_cache;
+
+        // finish writing any queued checkpoints before the networks go
+        delete checkpoint_writer;
 
         delete Q;
         delete Q_hat;
+        delete Q_f;
+        delete Q_hat_f;
+        delete exploration_rnd;
+        delete sampling_rnd;
+        delete environment_rnd;
         delete rnd;
 
-        if(gradient_monitoring)
-            if(grad_monitor_file.is_open())
-                grad_monitor_file.close();
+        // writes any metrics still queued
+        delete metrics;
     };
 
     /* TRAINING FUNCTIONS */
 
     void train_optimiser(const double epsilon);
 
+    /**
+     * @brief train_optimiser stepping num_envs episodes at once, one per environment of an EnvironmentPool. Each step
+     * the environments' states go through Q in one forward pass, the environments compile and extract their next states
+     * concurrently, then each environment's transition is added and trained on in turn, so a run performs as many
+     * training steps as train_optimiser. num_envs <= 1 is train_optimiser.
+     * 
+     * @param epsilon 
+     * @param num_envs 
+     */
+    void train_optimiser_parallel(const double epsilon, const unsigned int num_envs);
+
     void sampling(const double epsilon, bool terminate);
 
     void train_phase();
 
+    /**
+     * @brief Train without compiling or running anything: num_updates minibatch updates sampled from the transitions in
+     * a replay store recorded by an earlier run (see replay_filename), reporting q-value statistics every
+     * DEFAULT_OFFLINE_REPORT_PERIOD updates. Weights are saved as at the end of train_optimiser. The store must have been
+     * recorded with this agent's action space and feature count.
+     * 
+     * @param dataset_filename 
+     * @param num_updates 
+     */
+    void train_offline(const std::string& dataset_filename, const unsigned int num_updates);
+
+    /**
+     * @brief Q-value statistics of the network being trained over every transition in the replay buffer.
+     * 
+     * @return q_value_stats_t 
+     */
+    q_value_stats_t q_value_stats();
+
     /* HELPER FUNCTIONS*/
 
     /**
@@ -164,10 +310,38 @@ public:
      */
     int epsilon_greedy_action(const std::vector<double>& st, const double epsilon);
 
+    /**
+     * @brief epsilon_greedy_action for each of states, the greedy actions are found in one forward pass.
+     * 
+     * @param states 
+     * @param epsilon 
+     * @param action_pos out, action_pos[i] for states[i]
+     */
+    void epsilon_greedy_actions(const std::vector<std::vector<double>>& states, const double epsilon, std::vector<int>& action_pos);
+
     void copy_network_weights();
 
+    /**
+     * @brief Load weights into Q (and Q_hat) from either a binary checkpoint or a text weight export.
+     * 
+     * @param filename 
+     */
     void load_weights_from_file(const std::string& filename);
 
+    /**
+     * @brief Export the weights of the network being trained in the text format, the format is the same for every precision.
+     * 
+     * @param filename 
+     */
+    void save_weights_to_file(const std::string& filename);
+
+    /**
+     * @brief Queue a binary checkpoint of the network being trained on the background writer, returns once the weights are snapshotted.
+     * 
+     * @param filename 
+     */
+    void save_checkpoint_async(const std::string& filename);
+
     inline const std::vector<std::string>& get_actions() { return actions; };
 
     /**
@@ -180,7 +354,7 @@ public:
 
     inline double get_init_runtime() { return init_runtime; };
 
-    int get_num_features() { return Q->layers[0]->W.rows(); };
+    int get_num_features() { return network_config[0]; };
 
     PolyString* get_PolyString() { return curr_env; }; // dangerous function
 
@@ -194,14 +368,110 @@ public:
 
     /* STATIC TRAINED POLICY FUNCTIONS */
 
-    static std::vector<std::string> select_actions_via_policy(MLP* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, int num_actions);
+    /* Policy selection only uses the const inference path of the network, so concurrent calls may share one loaded Q_net */
 
-    static std::vector<std::string> select_actions_via_policy(MLP *Q_net, const std::string &program_name, const std::vector<std::string> &action_space, const std::string &optimisation_baseline);
+    static std::vector<std::string> select_actions_via_policy(const MLP* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, int num_actions, FeatureCache* feature_cache=NULL);
+
+    static std::vector<std::string> select_actions_via_policy(const MLP *Q_net, const std::string &program_name, const std::vector<std::string> &action_space, const std::string &optimisation_baseline, FeatureCache* feature_cache=NULL);
+
+    static std::vector<std::string> select_actions_via_policy(const QuantizedMLP* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, int num_actions, FeatureCache* feature_cache=NULL);
+
+    static std::vector<std::string> select_actions_via_policy(const QuantizedMLP* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, FeatureCache* feature_cache=NULL);
+
+    template<int... Sizes>
+    static std::vector<std::string> select_actions_via_policy(const StaticMLP<Sizes...>* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, int num_actions, FeatureCache* feature_cache=NULL)
+    {
+        // a StaticMLP given weights trained by Agent only computes the same q-values if it is the network Agent trains
+        static_assert(StaticMLP<Sizes...>::hidden_activation == DEFAULT_HIDDEN_ACTIVATION, "StaticMLP hidden activation does not match DEFAULT_HIDDEN_ACTIVATION");
+        static_assert(StaticMLP<Sizes...>::output_activation == DEFAULT_OUTPUT_ACTIVATION, "StaticMLP output activation does not match DEFAULT_OUTPUT_ACTIVATION");
+        static_assert(StaticMLP<Sizes...>::loss_function == &DEFAULT_LOSS_FUNCTION, "StaticMLP loss does not match DEFAULT_LOSS_FUNCTION");
+
+        return policy_rollout(Q_net, StaticMLP<Sizes...>::num_features, program_name, action_space, optimisation_baseline, num_actions, feature_cache);
+    }
+
+    template<int... Sizes>
+    static std::vector<std::string> select_actions_via_policy(const StaticMLP<Sizes...>* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, FeatureCache* feature_cache=NULL)
+    {
+        return select_actions_via_policy(Q_net, program_name, action_space, optimisation_baseline, action_space.size(), feature_cache);
+    }
 
     /* STATIC HELPER FUNCTIONS */
     
     static int best_q_action(const Eigen::MatrixXd& input, int n);
 
+private:
+
+    /* precision independent implementations, dispatched on by the functions above */
+
+    template<typename QNet, typename TargetNet>
+    void train_networks(QNet* q, TargetNet* q_hat);
+
+    template<typename QNet>
+    int greedy_action(QNet* q, const std::vector<double>& st);
+
+    template<typename QNet>
+    void greedy_actions(QNet* q, const std::vector<std::vector<double>>& states, const std::vector<int>& rows, std::vector<int>& action_pos);
+
+    /**
+     * @brief Reward at the end of an episode, printed and recorded to the metrics log.
+     */
+    double episode_reward(const double episode_init_runtime, const double updt_runtime);
+
+    template<typename QNet, typename TargetNet>
+    q_value_stats_t compute_q_value_stats(QNet* q, TargetNet* q_hat);
+
+    void report_q_value_stats();
+
+    template<typename FromNet, typename ToNet>
+    static void copy_weights(const FromNet* from, ToNet* to);
+
+    /**
+     * @brief Shared implementation of select_actions_via_policy for both MLP and StaticMLP networks. States come from
+     * feature_cache, or from a cache local to the rollout when it is NULL, so a repeated action never recompiles.
+     */
+    template<typename Net>
+    static std::vector<std::string> policy_rollout(const Net* Q_net, int num_features, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, int num_actions, FeatureCache* feature_cache);
+
 };
 
+
+/* TEMPLATE IMPLEMENTATIONS */
+
+
+template<typename Net>
+std::vector<std::string> Agent::policy_rollout(const Net* Q_net, int num_features, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, int num_actions, FeatureCache* feature_cache)
+{
+    std::vector<int> selected(action_space.size());
+    std::vector<double> curr_st;
+    typename Net::inference_scratch_t scratch;
+
+    FeatureCache rollout_cache;
+    if(feature_cache == NULL)
+        feature_cache = &rollout_cache;
+
+    // generate agent's environment
+    PolyString* my_env = construct_polybench_PolyString(program_name, optimisation_baseline);
+
+    int i;
+    for(i = 0; i < num_actions; i++)
+    {
+        // forward prop the curr_env to get q_vals
+        curr_st = vec_min_max_scaling(feature_cache->get_program_state(my_env, num_features));
+
+        Eigen::MatrixXd vals = Q_net->infer(curr_st, scratch).template cast<double>();
+
+        int best_pos = best_q_action(vals, vals.cols());
+
+        // append to ret vector only if not already selected
+        if(selected[best_pos] != 1)
+        {
+            selected[best_pos] = 1;
+            my_env->optimisations.push_back(action_space[best_pos]);
+        }
+    }
+
+    std::vector<std::string> ret(my_env->optimisations);
+    return ret;
+}
+
 #endif /* AGENT_H */
\ No newline at end of file
@@ -0,0 +1,394 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 25/04/2024
+ * FILE LAST UPDATED: 09/05/2024
+ *
+ * REQUIREMENTS: Eigen v3.4.0, src: https://eigen.tuxfamily.org/index.php?title=Main_Page
+ * REFERENCES: Volodymyr Mnih et al. "Human-level control through deep reinforcement learning."
+ *             Tom Schaul et al. "Prioritized experience replay."
+ *
+ * DESCRIPTION: Class definition for the fixed capacity experience replay buffer for DQL.
+*/
+
+#ifndef REPLAY_BUFFER_H
+#define REPLAY_BUFFER_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#include "Eigen/Core"
+
+#include "utils/rand_helper.h"
+
+#define DEFAULT_PRIORITY_ALPHA 0.6 /* 0 samples uniformly, 1 fully by priority */
+#define DEFAULT_PRIORITY_BETA 0.4 /* initial importance sampling correction, annealed to 1 over training */
+#define DEFAULT_PRIORITY_EPSILON 1e-6 /* keeps transitions with zero td error sampleable */
+
+
+/* REPLAY STORE FORMAT */
+
+/*
+ * Layout of a replay store, the same in memory and on disk, all integers little endian as written by the host:
+ *
+ *  replay_file_header_t, padded to REPLAY_ALIGNMENT
+ *  states              - 2 x capacity state rows of replay_state_format_t, only the first num_states are ever written
+ *  curr_state_idx      - capacity uint32, row of states holding each transition's current state
+ *  next_state_idx      - capacity uint32
+ *  rewards             - capacity doubles
+ *  action_positions    - capacity int32
+ *  terminates          - capacity bytes
+ *
+ * States are interned, each distinct state is stored once however many transitions refer to it. The state rows are
+ * never touched until used, so (as the storage is mapped) memory and disk use grow with the number of distinct states
+ * rather than with capacity. Every array starts on a REPLAY_ALIGNMENT boundary. A transition is written before
+ * num_added is incremented, so a store reopened after the process exits holds every transition that was added.
+ */
+
+#define REPLAY_MAGIC "DRLGCCR"
+#define REPLAY_VERSION 2
+#define REPLAY_ALIGNMENT 64
+
+#define DEFAULT_REPLAY_STATE_FORMAT REPLAY_STATE_FLOAT64
+
+/**
+ * @brief How each interned state row is stored.
+ */
+enum replay_state_format_t
+{
+    REPLAY_STATE_FLOAT64 = 0, /* num_features doubles, lossless */
+    REPLAY_STATE_FLOAT16 = 1, /* num_features halfs */
+    REPLAY_STATE_UINT8 = 2 /* float offset, float scale, num_features bytes, value = offset + (byte * scale) */
+};
+
+/**
+ * @brief Human readable name of the state format, used for agent information.
+ */
+inline const char* replay_state_format_to_string(replay_state_format_t format)
+{
+    switch(format)
+    {
+        case REPLAY_STATE_FLOAT16:
+            return "float16";
+        case REPLAY_STATE_UINT8:
+            return "uint8";
+        default:
+            return "float64";
+    }
+}
+
+struct replay_file_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_features;
+    uint32_t capacity;
+    uint32_t state_format; /* replay_state_format_t */
+    uint64_t action_space_hash; /* see ReplayBuffer::hash_action_space, action positions are only meaningful for the same action space */
+    uint64_t num_added; /* total transitions ever added, the next transition goes to num_added % capacity */
+};
+
+
+/* SAMPLING MODES */
+
+enum replay_sampling_t
+{
+    REPLAY_SAMPLING_UNIFORM,
+    REPLAY_SAMPLING_PRIORITISED /* proportional prioritised replay, see ReplayBuffer::sample */
+};
+
+
+/* SUM TREE */
+
+/**
+ * @brief Complete binary tree over capacity leaf priorities where each node holds the sum (and the minimum) of its
+ * children, so setting a priority and finding the leaf a prefix sum falls in are both O(log n).
+ */
+class SumTree
+{
+    int num_leaves; /* capacity rounded up to a power of two */
+
+    // node i has children 2i and 2i+1, leaves start at num_leaves, node 0 is unused
+    std::vector<double> sums;
+    std::vector<double> mins;
+
+public:
+    SumTree(const unsigned int capacity);
+
+    ~SumTree() {};
+
+    void set(const int leaf, const double priority);
+
+    inline double get(const int leaf) const { return sums[num_leaves + leaf]; };
+
+    /**
+     * @brief Leaf whose prefix sum interval contains u, u in [0, total()). Never returns a zero priority leaf while total() > 0.
+     *
+     * @param u
+     * @return int
+     */
+    int find(double u) const;
+
+    inline double total() const { return sums[1]; };
+
+    /**
+     * @brief Smallest priority that has been set, infinity if none have.
+     */
+    inline double min() const { return mins[1]; };
+};
+
+
+/* REPLAY BUFFER */
+
+
+/**
+ * @brief Fixed capacity ring of transitions stored as structure of arrays. Every array is allocated once on construction,
+ * and states are interned into a table of rows that transitions refer to by index, compressed as chosen by
+ * replay_state_format_t. Once full the oldest transition is overwritten and states no transition refers to any more are
+ * reused. The arrays either live in anonymous memory or in a memory mapped replay store file that outlives the process,
+ * see the format above.
+ */
+class ReplayBuffer
+{
+public:
+    /* TRANSITIONS - position i of each array belongs to transition i */
+
+    uint32_t* curr_state_idx;
+    uint32_t* next_state_idx;
+    double* rewards;
+    int32_t* action_positions;
+    unsigned char* terminates;
+
+private:
+    unsigned int capacity;
+    int num_features;
+
+    /* STORAGE - header followed by the arrays, mapped from filename or anonymous when filename is empty */
+    replay_file_header_t* header;
+    char* storage;
+    std::size_t storage_size;
+    std::string filename;
+
+    /* STATE TABLE */
+    replay_state_format_t state_format;
+    unsigned char* states;
+    std::size_t state_stride; /* bytes per state row */
+    unsigned int max_states;
+
+    // rows below num_states have been used, unreferenced ones are in free_states, neither is stored in the file
+    unsigned int num_states;
+    std::vector<uint32_t> state_refs;
+    std::vector<uint32_t> free_states;
+
+    // open addressing hash set of the referenced rows (row + 1, 0 is empty) for interning
+    std::vector<uint32_t> intern_table;
+    std::size_t intern_mask;
+
+    // a state being added, encoded before it is looked up
+    std::vector<unsigned char> encoded;
+
+    /* PRIORITISED REPLAY - priorities are stored raised to alpha, NULL when sampling uniformly */
+    replay_sampling_t sampling;
+    SumTree* priorities;
+    double alpha;
+    double max_priority; /* given to new transitions so each is replayed at least once */
+
+    bool map_file(const uint64_t action_space_hash);
+
+    void allocate(const uint64_t action_space_hash);
+
+    void attach_arrays();
+
+    void init_states();
+
+    void init_priorities();
+
+    inline unsigned char* state_row(const uint32_t state) { return states + (state * state_stride); };
+
+    inline const unsigned char* state_row(const uint32_t state) const { return states + (state * state_stride); };
+
+    void encode_state(const std::vector<double>& st, unsigned char* out) const;
+
+    uint32_t intern_state(const std::vector<double>& st);
+
+    void release_state(const uint32_t state);
+
+    void insert_interned(const uint32_t state);
+
+public:
+    /**
+     * @brief Allocate storage for capacity transitions of num_features long states.
+     *
+     * @param capacity
+     * @param num_features
+     * @param state_format
+     * @param sampling
+     * @param alpha priority exponent, prioritised sampling only
+     */
+    ReplayBuffer(const unsigned int capacity, const int num_features, const replay_state_format_t state_format=DEFAULT_REPLAY_STATE_FORMAT, const replay_sampling_t sampling=REPLAY_SAMPLING_UNIFORM, const double alpha=DEFAULT_PRIORITY_ALPHA);
+
+    /**
+     * @brief Open the replay store at filename, creating it if it does not exist. An existing store keeps its transitions
+     * (a warm start) as long as its capacity, feature count, state format and action space hash match, otherwise it is
+     * left untouched and the buffer falls back to anonymous memory, check is_file_backed.
+     *
+     * @param filename
+     * @param capacity
+     * @param num_features
+     * @param action_space_hash from hash_action_space
+     * @param state_format
+     * @param sampling
+     * @param alpha priority exponent, prioritised sampling only
+     */
+    ReplayBuffer(const std::string& filename, const unsigned int capacity, const int num_features, const uint64_t action_space_hash, const replay_state_format_t state_format=DEFAULT_REPLAY_STATE_FORMAT, const replay_sampling_t sampling=REPLAY_SAMPLING_UNIFORM, const double alpha=DEFAULT_PRIORITY_ALPHA);
+
+    ~ReplayBuffer();
+
+    /**
+     * @brief FNV-1a 64 of the action strings in order, stores are only reopened for the same action space.
+     *
+     * @param actions
+     * @return uint64_t
+     */
+    static uint64_t hash_action_space(const std::vector<std::string>& actions);
+
+    /**
+     * @brief Read the header of the replay store at filename without mapping it, e.g. to find the capacity to open it with.
+     *
+     * @param filename
+     * @param header out
+     * @return false if filename is not a replay store
+     */
+    static bool read_header(const std::string& filename, replay_file_header_t& header);
+
+    /**
+     * @brief Write a file backed store's dirty pages to disk, does nothing for anonymous storage.
+     */
+    void sync();
+
+    inline bool is_file_backed() const { return !filename.empty(); };
+
+    /**
+     * @brief Copy a transition into the buffer, overwriting the oldest once full. Each state is stored only if no
+     * transition in the buffer already has it. No allocation.
+     *
+     * @param curr_st
+     * @param action_pos
+     * @param reward
+     * @param next_st
+     * @param terminate
+     */
+    void add(const std::vector<double>& curr_st, const int action_pos, const double reward, const std::vector<double>& next_st, bool terminate);
+
+    /**
+     * @brief Decode state row state into row, converted to the row's scalar type.
+     *
+     * @param state
+     * @param row e.g. a row of a minibatch matrix
+     */
+    template<typename Row>
+    void decode_state(const uint32_t state, Row&& row) const
+    {
+        typedef typename std::decay<Row>::type::Scalar scalar_t;
+
+        const unsigned char* src = state_row(state);
+
+        switch(state_format)
+        {
+            case REPLAY_STATE_FLOAT16:
+                row = Eigen::Map<const Eigen::Matrix<Eigen::half, 1, Eigen::Dynamic>>((const Eigen::half*)src, num_features).template cast<float>().template cast<scalar_t>();
+                break;
+            case REPLAY_STATE_UINT8:
+            {
+                float offset_scale[2];
+                std::memcpy(offset_scale, src, sizeof(offset_scale));
+
+                row = ((Eigen::Map<const Eigen::Matrix<unsigned char, 1, Eigen::Dynamic>>(src + sizeof(offset_scale), num_features).template cast<scalar_t>().array() * scalar_t(offset_scale[1])) + scalar_t(offset_scale[0])).matrix();
+                break;
+            }
+            default:
+                row = Eigen::Map<const Eigen::RowVectorXd>((const double*)src, num_features).template cast<scalar_t>();
+                break;
+        }
+    };
+
+    /**
+     * @brief Gather the transitions at positions into row i of curr and next (converted to each matrix's scalar type),
+     * and element i of actions, batch_rewards and batch_terminates. Outputs must already hold positions.size() rows / elements.
+     *
+     * @param positions each in [0, size())
+     * @param curr
+     * @param next
+     * @param actions
+     * @param batch_rewards
+     * @param batch_terminates
+     */
+    template<typename CurrMatrix, typename NextMatrix>
+    void gather(const std::vector<int>& positions, CurrMatrix& curr, NextMatrix& next, int* actions, double* batch_rewards, unsigned char* batch_terminates) const
+    {
+        int i;
+        for(i = 0; i < (int)positions.size(); i++)
+        {
+            int pos = positions[i];
+
+            decode_state(curr_state_idx[pos], curr.row(i));
+            decode_state(next_state_idx[pos], next.row(i));
+
+            actions[i] = action_positions[pos];
+            batch_rewards[i] = rewards[pos];
+            batch_terminates[i] = terminates[pos];
+        }
+    };
+
+    /**
+     * @brief Choose positions.size() transitions to train on. Uniform sampling draws positions uniformly and sets every
+     * weight to 1. Prioritised sampling splits the total priority into positions.size() equal strata, draws one
+     * transition from each with probability P(i) = p_i / sum p, and sets weights[i] to the importance sampling weight
+     * (size() * P(i))^-beta normalised by the largest possible weight.
+     *
+     * @param rnd
+     * @param positions out
+     * @param weights out, same size as positions
+     * @param beta importance sampling exponent, prioritised sampling only
+     */
+    void sample(rand_helper* rnd, std::vector<int>& positions, std::vector<double>& weights, const double beta) const;
+
+    /**
+     * @brief Set the priority of each sampled transition from its latest td error, does nothing when sampling uniformly.
+     *
+     * @param positions
+     * @param td_errors
+     */
+    void update_priorities(const std::vector<int>& positions, const std::vector<double>& td_errors);
+
+    inline replay_sampling_t get_sampling() const { return sampling; };
+
+    inline replay_state_format_t get_state_format() const { return state_format; };
+
+    /**
+     * @brief Number of distinct states the transitions in the buffer refer to.
+     */
+    inline unsigned int num_unique_states() const { return num_states - free_states.size(); };
+
+    /**
+     * @brief Bytes of state rows in use, the state memory the buffer actually needs.
+     */
+    inline std::size_t state_bytes() const { return (std::size_t)num_states * state_stride; };
+
+    /**
+     * @brief Number of transitions held, capped at capacity.
+     */
+    inline unsigned int size() const { return (header->num_added < capacity) ? header->num_added : capacity; };
+
+    inline unsigned int get_capacity() const { return capacity; };
+
+    inline int get_num_features() const { return num_features; };
+
+    inline bool empty() const { return header->num_added == 0; };
+};
+
+#endif /* REPLAY_BUFFER_H */
@@ -0,0 +1,155 @@
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "mlp-cpp/network.h"
+
+/* BINARY CHECKPOINT FORMAT */
+
+/*
+ * Layout of a checkpoint file, all integers little endian as written by the host:
+ *
+ *  checkpoint_header_t
+ *  num_tensors x checkpoint_tensor_t   - shape table
+ *  zero padding up to CHECKPOINT_ALIGNMENT
+ *  tensor data                         - each tensor column major (Eigen default), in table order, padded to CHECKPOINT_ALIGNMENT
+ *
+ * The checksum is FNV-1a 64 over everything following the header, so files can be validated straight from an mmap.
+ * Layer weights are stored as CHECKPOINT_TENSOR_WEIGHTS, one per layer excluding the output layer, followed by the
+ * optimiser state the network's optimiser keeps (CHECKPOINT_TENSOR_OPTIMISER_M then CHECKPOINT_TENSOR_OPTIMISER_V, one per layer).
+ *
+ * Version 1 files have no optimiser state and a header that stops before optimiser_step, they are still loaded.
+ */
+
+#define CHECKPOINT_MAGIC "DRLGCCW"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_ALIGNMENT 64
+
+enum checkpoint_dtype_t
+{
+    CHECKPOINT_DTYPE_FLOAT32 = 0,
+    CHECKPOINT_DTYPE_FLOAT64 = 1
+};
+
+enum checkpoint_tensor_kind_t
+{
+    CHECKPOINT_TENSOR_WEIGHTS = 0,
+    CHECKPOINT_TENSOR_OPTIMISER_M = 1,
+    CHECKPOINT_TENSOR_OPTIMISER_V = 2
+};
+
+struct checkpoint_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype; /* checkpoint_dtype_t of every tensor */
+    uint32_t num_tensors;
+    uint32_t optimiser; /* mlp_optimiser_t the optimiser state belongs to, always zero (sgd) in version 1 */
+    uint64_t file_size;
+    uint64_t checksum;
+    uint64_t optimiser_step; /* BasicMLP::optimiser_step, version 2 onwards */
+};
+
+/* size of the header in version 1 files */
+#define CHECKPOINT_V1_HEADER_SIZE offsetof(checkpoint_header_t, optimiser_step)
+
+struct checkpoint_tensor_t
+{
+    uint32_t kind; /* checkpoint_tensor_kind_t */
+    uint32_t layer; /* layer the tensor belongs to */
+    uint32_t rows;
+    uint32_t cols;
+};
+
+
+/**
+ * @brief Serialise the network weights and optimiser state into the binary checkpoint format.
+ *
+ * @param net
+ * @return std::vector<char> complete file contents
+ */
+template<typename Scalar>
+std::vector<char> serialise_checkpoint(const BasicMLP<Scalar>* net);
+
+/**
+ * @brief Synchronously write a binary checkpoint of the network weights and optimiser state.
+ *
+ * @param net
+ * @param filename
+ * @return true on success
+ */
+template<typename Scalar>
+bool save_checkpoint(const BasicMLP<Scalar>* net, const std::string& filename);
+
+/**
+ * @brief Load a binary checkpoint through mmap into a network, the header, checksum and every layer shape are validated
+ * before any weight is written. Float and double checkpoints can be loaded into either network precision.
+ * Optimiser state is restored if the checkpoint was written with the network's optimiser, otherwise the network's
+ * optimiser state is reset and only the weights are loaded.
+ *
+ * @param net
+ * @param filename
+ * @return true on success, net is left untouched on failure
+ */
+template<typename Scalar>
+bool load_checkpoint(BasicMLP<Scalar>* net, const std::string& filename);
+
+/**
+ * @brief Returns true if filename starts with the binary checkpoint magic, used to tell checkpoints from text weight exports.
+ *
+ * @param filename
+ */
+bool is_checkpoint_file(const std::string& filename);
+
+
+/* ASYNCHRONOUS CHECKPOINT WRITER */
+
+/**
+ * @brief Writes checkpoints on a background thread so training does not stall on disk I/O.
+ * save() snapshots the weights in the calling thread (one copy per layer) and returns, the file is written to
+ * filename.tmp and renamed into place so a checkpoint on disk is always complete. If saves are queued faster than they
+ * can be written only the newest snapshot for each filename is kept.
+ */
+class CheckpointWriter
+{
+private:
+    struct pending_t
+    {
+        std::string filename;
+        std::vector<char> data;
+    };
+
+    std::vector<pending_t> pending;
+    bool writing;
+    bool stopping;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread worker;
+
+    void run();
+
+public:
+    CheckpointWriter();
+
+    ~CheckpointWriter();
+
+    template<typename Scalar>
+    void save(const BasicMLP<Scalar>* net, const std::string& filename);
+
+    /**
+     * @brief Block until every queued checkpoint has been written.
+     */
+    void flush();
+};
+
+
+#endif /* CHECKPOINT_H */
@@ -2,12 +2,127 @@
 #ifndef FUNCS_H
 #define FUNCS_H
 
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
 #include "Eigen/Core"
 
 #include "utils/rand_helper.h"
 
+/* helper typedefs */
+
+/* dynamic matrix of the network scalar type, networks are instantiated for float and double */
+template<typename Scalar>
+using mlp_matrix_t = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+
 /* ACTIVATION FUNCTIONS */
-/* All activation functions work coefficient wise on the given input matrix */
+
+/**
+ * @brief Built in activation functions, used to statically dispatch the fused activation kernels below.
+ * MLP_ACTIVATION_CUSTOM marks a layer using a user given mlp_activation_func_t.
+ */
+enum mlp_activation_t
+{
+    MLP_ACTIVATION_LINEAR,
+    MLP_ACTIVATION_RELU,
+    MLP_ACTIVATION_SIGMOID,
+    MLP_ACTIVATION_CUSTOM
+};
+
+/**
+ * @brief Fused activation kernel, computes the activation value and its derivative coefficient wise in the same call.
+ * Works on any contiguous Eigen matrix type (dynamic or fixed size), value and deriv are resized to match input.
+ * 
+ * @tparam A built in activation function
+ * @param input 
+ * @param value activation function applied to input
+ * @param deriv derivative of the activation function at input
+ */
+template<mlp_activation_t A, typename In, typename Out>
+inline void mlp_activate(const Eigen::MatrixBase<In>& input, Eigen::PlainObjectBase<Out>& value, Eigen::PlainObjectBase<Out>& deriv)
+{
+    typedef typename Out::Scalar scalar_t;
+
+    value.resize(input.rows(), input.cols());
+    deriv.resize(input.rows(), input.cols());
+
+    if constexpr(A == MLP_ACTIVATION_RELU)
+    {
+        // single pass over the input, simple enough for the compiler to vectorise
+        const scalar_t* in = input.derived().data();
+        scalar_t* __restrict v = value.data();
+        scalar_t* __restrict d = deriv.data();
+
+        Eigen::Index k;
+        for(k = 0; k < input.size(); k++)
+        {
+            scalar_t x = in[k];
+            v[k] = (x > 0) ? x : scalar_t(0);
+            d[k] = (x > 0) ? scalar_t(1) : scalar_t(0);
+        }
+    }
+    else if constexpr(A == MLP_ACTIVATION_SIGMOID)
+    {
+        // Eigen vectorises exp, derivative reuses the value while it is still in cache
+        value.array() = (scalar_t(1) + (-input.array()).exp()).inverse();
+        deriv.array() = value.array() * (scalar_t(1) - value.array());
+    }
+    else if constexpr(A == MLP_ACTIVATION_LINEAR)
+    {
+        // derivative of linear activation function is always 1
+        value = input;
+        deriv.setOnes();
+    }
+    else
+    {
+        static_assert(A != MLP_ACTIVATION_CUSTOM, "custom activation functions cannot be statically dispatched");
+    }
+}
+
+/**
+ * @brief Value only activation kernel applied in place, used by inference where the derivative is never needed.
+ * 
+ * @tparam A built in activation function
+ * @param value activation input, overwritten with the activation value
+ */
+template<mlp_activation_t A, typename Out>
+inline void mlp_activate_value(Eigen::PlainObjectBase<Out>& value)
+{
+    typedef typename Out::Scalar scalar_t;
+
+    if constexpr(A == MLP_ACTIVATION_RELU)
+        value = value.cwiseMax(scalar_t(0));
+    else if constexpr(A == MLP_ACTIVATION_SIGMOID)
+        value.array() = (scalar_t(1) + (-value.array()).exp()).inverse();
+    else if constexpr(A == MLP_ACTIVATION_CUSTOM)
+        static_assert(A != MLP_ACTIVATION_CUSTOM, "custom activation functions cannot be statically dispatched");
+
+    // linear is the identity
+}
+
+/**
+ * @brief Runtime dispatch onto the fused activation kernels for dynamic matrices.
+ * 
+ * @param type must not be MLP_ACTIVATION_CUSTOM
+ * @param input 
+ * @param value 
+ * @param deriv 
+ */
+template<typename Scalar>
+void mlp_activate(mlp_activation_t type, const mlp_matrix_t<Scalar>& input, mlp_matrix_t<Scalar>& value, mlp_matrix_t<Scalar>& deriv);
+
+/**
+ * @brief Runtime dispatch onto the value only activation kernels for dynamic matrices.
+ * 
+ * @param type must not be MLP_ACTIVATION_CUSTOM
+ * @param value 
+ */
+template<typename Scalar>
+void mlp_activate_value(mlp_activation_t type, mlp_matrix_t<Scalar>& value);
+
+/* All activation functions below work coefficient wise on the given input matrix */
+/* These are kept for compatibility with mlp_activation_func_t, networks map them onto the fused kernels above */
 
 Eigen::MatrixXd mlp_sigmoid(const Eigen::MatrixXd& input, bool deriv);
 
@@ -28,6 +143,8 @@ void he_normal_initialiser(Eigen::MatrixXd& mat, int fan_in, int fan_out, rand_h
 
 /* LOSS FUNCTIONS */
 
+#define DQL_ERROR_CLIP_VALUE 0.5 /* error at the action position is clipped to [-DQL_ERROR_CLIP_VALUE, DQL_ERROR_CLIP_VALUE], keep positive */
+
 /**
  * @brief Loss function of standard deep q-learning.
  * 
@@ -61,6 +178,55 @@ Eigen::MatrixXd huber_loss(const Eigen::MatrixXd& output, const Eigen::MatrixXd&
 
 Eigen::MatrixXd standard_loss(const Eigen::MatrixXd& output, const Eigen::MatrixXd& target, int action_pos);
 
+/* IN-PLACE LOSS FUNCTIONS */
+/* Minibatch versions of the above, row i of res is the loss of row i of output and target at action_pos[i] */
+/* Instantiated for float and double networks */
+
+template<typename Scalar>
+void dql_square_loss_into(const mlp_matrix_t<Scalar>& output, const mlp_matrix_t<Scalar>& target, const std::vector<int>& action_pos, mlp_matrix_t<Scalar>& res);
+
+template<typename Scalar>
+void dql_square_loss_with_error_clipping_into(const mlp_matrix_t<Scalar>& output, const mlp_matrix_t<Scalar>& target, const std::vector<int>& action_pos, mlp_matrix_t<Scalar>& res);
+
+template<typename Scalar>
+void huber_loss_into(const mlp_matrix_t<Scalar>& output, const mlp_matrix_t<Scalar>& target, const std::vector<int>& action_pos, mlp_matrix_t<Scalar>& res);
+
+template<typename Scalar>
+void standard_loss_into(const mlp_matrix_t<Scalar>& output, const mlp_matrix_t<Scalar>& target, const std::vector<int>& action_pos, mlp_matrix_t<Scalar>& res);
+
+/* SPARSE LOSS FUNCTIONS */
+/* Loss at the action position only, for rows whose output is zero everywhere except action_pos (the deep q-learning targets */
+/* built by Agent). The deep q-learning losses above are then zero off the action position so this single value is the whole row */
+
+template<typename Scalar>
+inline Scalar dql_square_loss_sparse(Scalar output, Scalar target)
+{
+    Scalar err = output - target;
+    return err * err;
+}
+
+template<typename Scalar>
+inline Scalar dql_square_loss_with_error_clipping_sparse(Scalar output, Scalar target)
+{
+    Scalar err_clip_val = DQL_ERROR_CLIP_VALUE;
+
+    Scalar err = std::min(std::max(output - target, -err_clip_val), err_clip_val);
+    return err * err;
+}
+
+template<typename Scalar>
+inline Scalar huber_loss_sparse(Scalar output, Scalar target)
+{
+    Scalar huber_delta = 1; // clipping between -1 and 1
+
+    Scalar err = std::fabs(output - target);
+
+    if(err <= huber_delta)
+        return Scalar(0.5) * (err * err);
+
+    return huber_delta * (err - (Scalar(0.5) * huber_delta));
+}
+
 /* SCALING FUNCTIONS */
 
 /**
@@ -5,9 +5,14 @@
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <functional>
+#include <cstring>
+#include <cmath>
 
 #include "Eigen/Core"
 
+#include "mlp-cpp/funcs.h"
+#include "mlp-cpp/thread_pool.h"
 #include "utils/rand_helper.h"
 
 /* helper typedefs */
@@ -18,36 +23,126 @@ typedef std::function<void(Eigen::MatrixXd& mat, int fan_in, int fan_out, rand_h
 
 typedef std::function<Eigen::MatrixXd(const Eigen::MatrixXd& output, const Eigen::MatrixXd& target, int action_pos)> mlp_loss_func_t;
 
+/* in-place version used by the network workspace, see funcs.h */
+
+template<typename Scalar>
+using mlp_loss_into_func_t = void (*)(const mlp_matrix_t<Scalar>& output, const mlp_matrix_t<Scalar>& target, const std::vector<int>& action_pos, mlp_matrix_t<Scalar>& res);
+
+/* single output version for the sparse deep q-learning path, see funcs.h */
+
+template<typename Scalar>
+using mlp_sparse_loss_func_t = Scalar (*)(Scalar output, Scalar target);
+
+/* constant bias added to the weighted sum of every non-input layer */
+#define DEFAULT_BIAS 1.0
+
+
+/* OPTIMISERS */
+
+/**
+ * @brief Update rule used by update_weights, state for the adaptive optimisers is held in each layer's M and V matrices.
+ */
+enum mlp_optimiser_t
+{
+    MLP_OPTIMISER_SGD = 0, /* W -= lr * g */
+    MLP_OPTIMISER_MOMENTUM = 1, /* M = beta1 * M + g, W -= lr * M */
+    MLP_OPTIMISER_RMSPROP = 2, /* V = beta2 * V + (1 - beta2) * g^2, W -= lr * g / (sqrt(V) + eps) */
+    MLP_OPTIMISER_ADAM = 3 /* Kingma and Ba, bias corrected first (M) and second (V) moments */
+};
+
+#define DEFAULT_OPTIMISER MLP_OPTIMISER_SGD
+#define DEFAULT_BETA1 0.9
+#define DEFAULT_BETA2 0.999
+#define DEFAULT_OPTIMISER_EPSILON 1e-8
+
+/* rows of a minibatch handled by each task in data parallel training, see BasicMLP::set_num_threads */
+#define DEFAULT_SHARD_ROWS 32
+
+/* alignment in bytes of the parameter slabs and of every layer's tensor within them, see BasicMLP flat parameter storage */
+#define MLP_SLAB_ALIGNMENT 64
+
+/* which of the layer state matrices the optimiser keeps */
+
+inline bool optimiser_uses_M(mlp_optimiser_t optimiser)
+{
+    return (optimiser == MLP_OPTIMISER_MOMENTUM) || (optimiser == MLP_OPTIMISER_ADAM);
+}
+
+inline bool optimiser_uses_V(mlp_optimiser_t optimiser)
+{
+    return (optimiser == MLP_OPTIMISER_RMSPROP) || (optimiser == MLP_OPTIMISER_ADAM);
+}
+
+/**
+ * @brief Human readable name of the optimiser, used for agent information.
+ */
+inline const char* optimiser_to_string(mlp_optimiser_t optimiser)
+{
+    switch(optimiser)
+    {
+        case MLP_OPTIMISER_MOMENTUM:
+            return "momentum";
+        case MLP_OPTIMISER_RMSPROP:
+            return "rmsprop";
+        case MLP_OPTIMISER_ADAM:
+            return "adam";
+        default:
+            return "sgd";
+    }
+}
+
 
 /* main network class definitions */
+/* Networks are templated on their scalar type and instantiated for float and double, MLP and Layer are the double versions */
+/* The function typedefs above always work in double, float networks convert on the way in and out of custom functions */
 
-class Layer
+template<typename Scalar>
+class BasicLayer
 {
 private:
     bool is_input;
     bool is_output;
 
 public:
+    typedef Scalar scalar_t;
+    typedef mlp_matrix_t<Scalar> matrix_t;
+    typedef Eigen::Matrix<Scalar, 1, Eigen::Dynamic> row_vector_t;
+
+    /* view of one layer's tensor in a BasicMLP parameter slab, assigning to it copies into the slab */
+    typedef Eigen::Map<matrix_t, Eigen::Aligned64> param_map_t;
 
     /* MATRICES */
 
-    Eigen::MatrixXd W; /* weight matrix */
+    param_map_t W; /* weight matrix */
 
-    Eigen::MatrixXd S; /* input to layer */
+    row_vector_t B; /* bias added to the weighted sum into the next layer */
 
-    Eigen::MatrixXd Z; /* output from layer after activation function */
+    matrix_t S; /* input to layer */
 
-    Eigen::MatrixXd G; /* Gradient matrix for BP step */
+    matrix_t Z; /* output from layer after activation function */
 
-    Eigen::MatrixXd Fp; /* Derivative of the activation function */
+    matrix_t G; /* Gradient matrix for BP step */
+
+    matrix_t Fp; /* Derivative of the activation function */
+
+    /* OPTIMISER STATE - same shape as W, empty if the network's optimiser does not use them */
+
+    param_map_t dW; /* averaged weight gradient of the last update */
+
+    param_map_t M; /* momentum velocity or Adam first moment */
+
+    param_map_t V; /* RMSProp or Adam second moment */
 
     /* ACTIVATION FUNCTION */
 
     mlp_activation_func_t activation_function;
 
+    /* fused kernel used for activation_function, MLP_ACTIVATION_CUSTOM if a custom activation function has been given */
+    mlp_activation_t activation_type;
+
 public:
 
-    Layer
+    BasicLayer
     (
         int num_neurons,
         int num_next_neurons, 
@@ -57,52 +152,338 @@ public:
         rand_helper* rnd
     );
 
-    Eigen::MatrixXd weighted_sum(double bias);
+    BasicLayer
+    (
+        int num_neurons,
+        int num_next_neurons, 
+        bool is_input, 
+        bool is_output, 
+        mlp_activation_t activation_type,
+        rand_helper* rnd
+    );
+
+    /**
+     * @brief Compute Fp and Z from S in place, no-op for the input layer.
+     */
+    void activate();
+
+    /**
+     * @brief Write the weighted sum of this layer's output plus bias into next_S (the next layer's input).
+     * 
+     * @param next_S 
+     */
+    void weighted_sum(matrix_t& next_S) const;
+
+    /**
+     * @brief Compute Z and Fp from S without touching the layer's matrices, used by the data parallel shards.
+     * 
+     * @param S 
+     * @param Z 
+     * @param Fp 
+     */
+    void activate(const matrix_t& S, matrix_t& Z, matrix_t& Fp) const;
+
+    /**
+     * @brief Apply only the activation function to X in place, does not touch the layer's matrices.
+     * 
+     * @param X 
+     */
+    void activate_value(matrix_t& X) const;
 
 };
 
 
-class MLP
+template<typename Scalar>
+class BasicMLP
 {
 public:
+    typedef Scalar scalar_t;
+    typedef mlp_matrix_t<Scalar> matrix_t;
+
+    typedef typename BasicLayer<Scalar>::param_map_t param_map_t;
+
     /* MLP layers */
-    std::vector<Layer*> layers;
+    std::vector<BasicLayer<Scalar>*> layers;
+
+    /* FLAT PARAMETER STORAGE */
+    /* Weights, gradients and optimiser state each live in one MLP_SLAB_ALIGNMENT aligned buffer with the same layout, every */
+    /* layer's tensor starting on an aligned boundary with zero padding between them. The layers' W, dW, M and V are views */
+    /* into these, a slab is NULL while nothing uses it. Whole network operations are single loops over slab_size elements */
+    /* and the layout matches a checkpoint's tensor data so a slab is saved and loaded with one copy. */
+    Scalar* weight_slab;
+    Scalar* gradient_slab;
+    Scalar* M_slab;
+    Scalar* V_slab;
+
+    std::size_t slab_size; /* elements in each slab, including padding */
+    std::vector<std::size_t> slab_offsets; /* element offset of each layer's tensor */
 
     /* params */
     double learning_rate;
 
+    /* optimiser and its hyperparameters, beta1 is also the momentum coefficient and beta2 the RMSProp decay */
+    mlp_optimiser_t optimiser;
+    double beta1;
+    double beta2;
+    double optimiser_epsilon;
+
+    /* number of update_weights calls since the optimiser state was reset, used for Adam bias correction */
+    unsigned long optimiser_step;
+
     /* misc */
     int num_layers;
+    std::vector<int> layer_config; /* neurons in each layer */
 
     /* loss function */
     mlp_loss_func_t loss_function;
 
+    /* in-place version of loss_function, NULL if a custom loss function has been given */
+    mlp_loss_into_func_t<Scalar> loss_into;
+
+    /* action position only version of loss_function, NULL if the loss has no sparse form */
+    mlp_sparse_loss_func_t<Scalar> loss_sparse;
+
+    /**
+     * @brief Caller owned scratch space for infer, give each thread its own.
+     */
+    struct inference_scratch_t
+    {
+        matrix_t input;
+        matrix_t A;
+        matrix_t B;
+    };
+
+private:
+    /* single sample action position for back_propogate_rl without allocating */
+    std::vector<int> single_action_pos;
+
+    /* DATA PARALLEL TRAINING */
+
+    /**
+     * @brief Thread local workspace for a contiguous block of minibatch rows, matrices are indexed as layers.
+     */
+    struct shard_t
+    {
+        int row_start;
+        int num_rows;
+
+        std::vector<matrix_t> S;
+        std::vector<matrix_t> Z;
+        std::vector<matrix_t> Fp;
+        std::vector<matrix_t> G;
+        std::vector<matrix_t> dW; /* unaveraged weight gradient of the shard's rows */
+
+        matrix_t yj;
+        std::vector<int> action_pos;
+    };
+
+    /* NULL when training single threaded */
+    ThreadPool* pool;
+
+    int shard_rows;
+    std::vector<shard_t> shards;
+
+    /* true if the last minibatch went through the shards, backward and update follow the forward pass */
+    bool sharded;
+
+    /* SPARSE OUTPUT GRADIENT */
+
+    /* true if the last back propogation only had a gradient at one output per row */
+    bool sparse_output;
+
+    /* gradient of row i at output sparse_pos[i] */
+    std::vector<Scalar> sparse_G;
+    std::vector<int> sparse_pos;
+
+    /* dense targets for losses without a sparse form */
+    matrix_t sparse_yj;
+
+    /* per row scale of the output gradient for the back propogation in progress, empty when unweighted */
+    std::vector<Scalar> sample_weights;
+
 public:
-    MLP
+    BasicMLP
     (
         const std::vector<int> &layer_config,
         const std::pair<mlp_activation_func_t, mlp_activation_func_t> &func_pair,
         weight_init_func_t initialiser,
         mlp_loss_func_t loss_function,
         rand_helper *rnd,
-        double learning_rate = 0.3
+        double learning_rate = 0.3,
+        mlp_optimiser_t optimiser = DEFAULT_OPTIMISER
     );
 
-    /* main network functions */
-    Eigen::MatrixXd forward_propogate(const std::vector<double>& input);
+    /**
+     * @brief Construct a new MLP using the built in activation functions, preferred over the mlp_activation_func_t constructor.
+     */
+    BasicMLP
+    (
+        const std::vector<int> &layer_config,
+        const std::pair<mlp_activation_t, mlp_activation_t> &type_pair,
+        weight_init_func_t initialiser,
+        mlp_loss_func_t loss_function,
+        rand_helper *rnd,
+        double learning_rate = 0.3,
+        mlp_optimiser_t optimiser = DEFAULT_OPTIMISER
+    );
 
-    void back_propogate(const Eigen::MatrixXd& target);
+    ~BasicMLP();
 
-    void back_propogate_rl(const Eigen::MatrixXd& yj, int action_pos);
+    /**
+     * @brief Split minibatches passed to forward_propogate across num_threads threads (including the caller). The batch is cut
+     * into shards of shard_rows rows, each shard computes its gradient into its own buffers and the gradients are summed in
+     * shard order before the optimiser step, so results do not depend on the number of threads or on scheduling.
+     * Only the output layer's Z is kept in layers for sharded batches. Minibatches of at most shard_rows rows are not split
+     * and train single threaded. num_threads of 0 goes back to single threaded training.
+     * 
+     * @param num_threads 
+     * @param shard_rows 
+     */
+    void set_num_threads(int num_threads, int shard_rows = DEFAULT_SHARD_ROWS);
 
+    /* main network functions */
+
+    /* Network outputs are returned by reference to the output layer's Z and are overwritten by the next forward_propogate call */
+
+    const matrix_t& forward_propogate(const std::vector<double>& input);
+
+    /**
+     * @brief Forward propogate a minibatch through the network, each row of input is one sample.
+     * 
+     * @param input N x num_features matrix
+     * @return const matrix_t& N x num_outputs matrix
+     */
+    const matrix_t& forward_propogate(const matrix_t& input);
+
+    /* INFERENCE */
+    /* infer is const and only writes to the given scratch space so one trained network can be shared between threads */
+    /* It skips the activation derivatives and gradients, results are returned by reference into scratch */
+
+    const matrix_t& infer(const std::vector<double>& input, inference_scratch_t& scratch) const;
+
+    /**
+     * @brief Inference over a batch of states, each row of input is one sample.
+     * 
+     * @param input N x num_features matrix
+     * @param scratch 
+     * @return const matrix_t& N x num_outputs matrix
+     */
+    const matrix_t& infer(const matrix_t& input, inference_scratch_t& scratch) const;
+
+    void back_propogate(const matrix_t& target);
+
+    void back_propogate_rl(const matrix_t& yj, int action_pos);
+
+    /**
+     * @brief Back propogate a minibatch previously passed to forward_propogate, row i of yj holds the target for action_pos[i].
+     * 
+     * @param yj N x num_outputs matrix
+     * @param action_pos N action indices
+     */
+    void back_propogate_rl(const matrix_t& yj, const std::vector<int>& action_pos);
+
+    /**
+     * @brief Deep q-learning back propogation where row i only has a target y[i] at action_pos[i] and no gradient elsewhere.
+     * Only column action_pos[i] of the last weight matrix is used for row i, the gradient into the last hidden layer is
+     * rank one per row and update_weights only touches the selected columns of the last weights (for sgd), so the cost
+     * does not grow with the number of outputs. Same result as back_propogate_rl with a yj that is zero off the action
+     * positions. Losses without a sparse form (loss_sparse NULL) fall back to the dense path.
+     * 
+     * @param y N targets
+     * @param action_pos N action indices
+     */
+    void back_propogate_rl_sparse(const std::vector<double>& y, const std::vector<int>& action_pos);
+
+    /**
+     * @brief back_propogate_rl_sparse with the gradient of row i scaled by sample_weights[i], e.g. importance sampling
+     * weights of a prioritised replay minibatch.
+     * 
+     * @param y N targets
+     * @param action_pos N action indices
+     * @param sample_weights N weights
+     */
+    void back_propogate_rl_sparse(const std::vector<double>& y, const std::vector<int>& action_pos, const std::vector<double>& sample_weights);
+
+    /**
+     * @brief Optimiser step using the gradients of the last back propogation, averaged over the rows of the minibatch.
+     */
     void update_weights();
+
+    /**
+     * @brief Change the optimiser, zeroing each layer's optimiser state and the step count.
+     * 
+     * @param optimiser 
+     */
+    void set_optimiser(mlp_optimiser_t optimiser);
+
+    /* WHOLE NETWORK PARAMETER OPERATIONS - net must have the same layer config */
+
+    /**
+     * @brief Copy every weight of net into this network, a single memcpy of the weight slab between networks of the same
+     * precision, used for target network syncs.
+     *
+     * @param net
+     */
+    template<typename OtherScalar>
+    void copy_weights_from(const BasicMLP<OtherScalar>* net);
+
+    /**
+     * @brief Soft (Polyak) target update W = (1 - tau) * W + tau * W_net, one vectorised pass over the weight slab.
+     *
+     * @param net
+     * @param tau
+     */
+    template<typename OtherScalar>
+    void soft_update_from(const BasicMLP<OtherScalar>* net, double tau);
+
+private:
+    /* allocate (zeroed) or free slab so it exists exactly when used, and point every layer's tensor view into it */
+    void resize_slab(Scalar*& slab, bool used, param_map_t BasicLayer<Scalar>::* tensor);
+
+    /* exit if net's parameters are not laid out like this network's */
+    template<typename OtherScalar>
+    void check_same_layout(const BasicMLP<OtherScalar>* net) const;
+
+    /* shared forward propogation once the input layer's Z has been set */
+    const matrix_t& propogate_input();
+
+    /* apply the optimiser to the averaged gradients in the dW of the first num_weights layers */
+    void apply_gradients(int num_weights);
+
+    /* weight gradient of the last layer from the sparse output gradient, sgd updates the weights directly */
+    void sparse_gradient();
+
+    /* matrix holding row i of the minibatch's last hidden layer output, row is set to i's row within it */
+    const matrix_t& last_hidden_Z(int i, int& row) const;
+
+    /* DATA PARALLEL TRAINING */
+
+    const matrix_t& forward_sharded(const matrix_t& input);
+
+    /* back propogate each shard from the output gradient already in its G, accumulating its weight gradient */
+    void back_propogate_shard(shard_t& shard);
+
+    /* sum the shard gradients into the dW of the first num_weights layers in shard order */
+    void reduce_gradients(int num_weights);
 };
 
+
+typedef BasicLayer<double> Layer;
+typedef BasicMLP<double> MLP;
+
+/* single precision network, see Agent precision modes */
+typedef BasicLayer<float> Layerf;
+typedef BasicMLP<float> MLPf;
+
+
 /* LOADING AND SAVING WEIGHTS */
+/* Text format is independent of the scalar type so weights can be moved between float and double networks */
 
-void save_weights(const MLP* net, const std::string& filename);
+template<typename Scalar>
+void save_weights(const BasicMLP<Scalar>* net, const std::string& filename);
 
-void load_weights(MLP* net, const std::string& filename);
+template<typename Scalar>
+void load_weights(BasicMLP<Scalar>* net, const std::string& filename);
 
 
-#endif /* NETWORK_H */
\ No newline at end of file
+#endif /* NETWORK_H */
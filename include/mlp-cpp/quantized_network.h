@@ -0,0 +1,115 @@
+
+#ifndef QUANTIZED_NETWORK_H
+#define QUANTIZED_NETWORK_H
+
+#include <vector>
+#include <cstdint>
+
+#include "Eigen/Core"
+
+#include "mlp-cpp/network.h"
+#include "mlp-cpp/funcs.h"
+
+
+/* INT8 QUANTIZED INFERENCE */
+
+/*
+ * Weights are quantized symmetrically to int8 with one scale per layer, w = scale * w_q.
+ * Layer inputs are quantized to int8 on the fly with one scale per sample, products are accumulated in int32 and
+ * dequantized to float before the bias and activation function, so only the stored network and the inner loops are int8.
+ * Weight rows are padded to a multiple of QUANTIZED_BLOCK outputs so the accumulation loop has a fixed trip count and is
+ * vectorised at -O2.
+ */
+
+#define QUANTIZED_MAX 127
+#define QUANTIZED_BLOCK 16
+
+
+/**
+ * @brief Inference only int8 copy of a trained network, built offline from a network loaded with load_weights or
+ * load_checkpoint. Layers follow MLP, quantized layer i holds the weights from layer i into layer i+1.
+ */
+class QuantizedMLP
+{
+public:
+    typedef float scalar_t;
+    typedef mlp_matrix_t<float> matrix_t;
+    typedef Eigen::Matrix<int8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> qmatrix_t;
+
+    struct QuantizedLayer
+    {
+        qmatrix_t W; /* in x padded out, row major so the weights from each input are contiguous, padding is zero */
+
+        int num_outputs; /* unpadded */
+
+        float scale; /* W ~= scale * W_q */
+
+        Eigen::Matrix<float, 1, Eigen::Dynamic> B; /* bias added to the weighted sum */
+
+        /* activation of the layer the weights feed into */
+        mlp_activation_t activation_type;
+        mlp_activation_func_t activation_function;
+    };
+
+    std::vector<QuantizedLayer> layers;
+
+    /* number of layers of the original network, including input and output */
+    int num_layers;
+
+    /**
+     * @brief Caller owned scratch space for infer, give each thread its own.
+     */
+    struct inference_scratch_t
+    {
+        std::vector<int8_t> input_q;
+        std::vector<int32_t> acc;
+        std::vector<matrix_t> Z; /* output of each layer, one matrix per layer so sizes never change between calls */
+    };
+
+public:
+    /**
+     * @brief Quantize a trained network, the network is only read.
+     *
+     * @param net
+     */
+    template<typename Scalar>
+    QuantizedMLP(const BasicMLP<Scalar>* net);
+
+    int get_num_features() const { return layers[0].W.rows(); };
+
+    int get_num_outputs() const { return layers.back().num_outputs; };
+
+    /**
+     * @brief Q values of a single state, const so one quantized network can be shared between threads.
+     *
+     * @param input
+     * @param scratch
+     * @return const matrix_t& 1 x num_outputs, overwritten by the next call with the same scratch
+     */
+    const matrix_t& infer(const std::vector<double>& input, inference_scratch_t& scratch) const;
+};
+
+
+/* AGREEMENT REPORT */
+
+struct quantization_report_t
+{
+    int num_states;
+    int argmax_agreement; /* states where both networks pick the same action */
+    double max_abs_error; /* largest difference in any Q value */
+    double mean_abs_error; /* mean difference over every Q value */
+};
+
+/**
+ * @brief Compare the quantized network against the network it was built from over the given states.
+ *
+ * @param net
+ * @param qnet
+ * @param states
+ * @return quantization_report_t
+ */
+template<typename Scalar>
+quantization_report_t compare_quantized(const BasicMLP<Scalar>* net, const QuantizedMLP* qnet, const std::vector<std::vector<double>>& states);
+
+
+#endif /* QUANTIZED_NETWORK_H */
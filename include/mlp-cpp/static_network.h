@@ -0,0 +1,413 @@
+#ifndef STATIC_NETWORK_H
+#define STATIC_NETWORK_H
+
+#include <iostream>
+#include <vector>
+#include <fstream>
+#include <tuple>
+#include <utility>
+#include <array>
+#include <cmath>
+
+#include "Eigen/Core"
+
+#include "mlp-cpp/network.h"
+#include "mlp-cpp/funcs.h"
+#include "utils/rand_helper.h"
+
+
+/**
+ * @brief Compile-time fixed-topology specialisation of MLP, e.g. StaticMLP<7, 30, 30, 30, 11>. Every matrix is a fixed size
+ * Eigen type and every layer is unrolled at compile time so tiny networks can be fully inlined and vectorised.
+ * Uses hidden ReLU layers, a linear output layer and the clipped deep q-learning loss, matching the DEFAULT_* network used within Agent.
+ * Agent's select_actions_via_policy fails to compile for a StaticMLP if those defaults are changed to anything else.
+ * Sizes are the layer widths from input to output.
+ * Only single sample sgd steps are supported, so Agent always trains the dynamic MLP and StaticMLP is only used to roll
+ * out a trained policy (select_actions_via_policy), with weights copied or loaded from the MLP. example_static_mlp checks
+ * the two stay equal.
+ */
+template<int... Sizes>
+class StaticMLP
+{
+public:
+    static constexpr int num_layers = sizeof...(Sizes);
+    static constexpr std::array<int, sizeof...(Sizes)> layer_sizes = {Sizes...};
+
+    static constexpr int num_features = layer_sizes[0];
+    static constexpr int num_outputs = layer_sizes[num_layers - 1];
+
+    static_assert(num_layers >= 2, "StaticMLP needs at least an input and an output layer");
+
+    /* fixed activations and loss, the only ones the unrolled layers compute. Agent checks them against its DEFAULT_* */
+
+    static constexpr mlp_activation_t hidden_activation = MLP_ACTIVATION_RELU;
+    static constexpr mlp_activation_t output_activation = MLP_ACTIVATION_LINEAR;
+
+    /* back_propogate_rl computes this loss with clip value DQL_ERROR_CLIP_VALUE */
+    static constexpr Eigen::MatrixXd (*loss_function)(const Eigen::MatrixXd&, const Eigen::MatrixXd&, int) = dql_square_loss_with_error_clipping;
+
+    /* helper typedefs */
+
+    template<std::size_t I>
+    using row_t = Eigen::Matrix<double, 1, layer_sizes[I]>;
+
+    template<std::size_t I>
+    using weight_t = Eigen::Matrix<double, layer_sizes[I], layer_sizes[I+1]>;
+
+    typedef row_t<0> input_t;
+    typedef row_t<num_layers - 1> output_t;
+
+private:
+    template<std::size_t... I>
+    static std::tuple<weight_t<I>...> make_weights(std::index_sequence<I...>);
+
+    template<std::size_t... I>
+    static std::tuple<row_t<I>...> make_rows(std::index_sequence<I...>);
+
+    typedef decltype(make_weights(std::make_index_sequence<num_layers - 1>())) weights_tuple_t;
+    typedef decltype(make_rows(std::make_index_sequence<num_layers>())) rows_tuple_t;
+
+public:
+
+    /* MATRICES - element I of each tuple belongs to layer I, as in MLP::layers */
+
+    weights_tuple_t W; /* weight matrices (no output layer) */
+
+    rows_tuple_t Z; /* output from each layer after activation function */
+
+    rows_tuple_t Fp; /* derivative of the activation function (unused for input) */
+
+    rows_tuple_t G; /* gradient for BP step (unused for input) */
+
+    /* params */
+    double learning_rate;
+
+    /**
+     * @brief Caller owned scratch space for infer, give each thread its own.
+     */
+    struct inference_scratch_t
+    {
+        rows_tuple_t Z;
+    };
+
+public:
+    /**
+     * @brief Construct a new StaticMLP, weights are initialised in the same order as MLP so equal seeds give equal networks.
+     *
+     * @param initialiser NULL for uniform weights in [-1, 1]
+     * @param rnd
+     * @param learning_rate
+     */
+    StaticMLP(weight_init_func_t initialiser, rand_helper* rnd, double learning_rate = 0.3)
+    : learning_rate(learning_rate)
+    {
+        init_weights<0>(initialiser, rnd);
+    }
+
+    /* main network functions */
+
+    const output_t& forward_propogate(const std::vector<double>& input)
+    {
+        if(input.size() != num_features)
+        {
+            std::cerr << "Data input to network is not of correct size, or network layout has been set incorrectly, exiting!\n";
+            std::exit(-1);
+        }
+
+        std::get<0>(Z) = Eigen::Map<const input_t>(input.data());
+        forward_layer<1>();
+
+        return std::get<num_layers - 1>(Z);
+    }
+
+    const output_t& forward_propogate(const input_t& input)
+    {
+        std::get<0>(Z) = input;
+        forward_layer<1>();
+
+        return std::get<num_layers - 1>(Z);
+    }
+
+    /* INFERENCE - const and only writes to scratch so one network can be shared between threads, skips derivatives */
+
+    const output_t& infer(const std::vector<double>& input, inference_scratch_t& scratch) const
+    {
+        if(input.size() != num_features)
+        {
+            std::cerr << "Data input to network is not of correct size, or network layout has been set incorrectly, exiting!\n";
+            std::exit(-1);
+        }
+
+        std::get<0>(scratch.Z) = Eigen::Map<const input_t>(input.data());
+        infer_layer<1>(scratch);
+
+        return std::get<num_layers - 1>(scratch.Z);
+    }
+
+    const output_t& infer(const input_t& input, inference_scratch_t& scratch) const
+    {
+        std::get<0>(scratch.Z) = input;
+        infer_layer<1>(scratch);
+
+        return std::get<num_layers - 1>(scratch.Z);
+    }
+
+    void back_propogate_rl(const output_t& yj, int action_pos)
+    {
+        /* output layer - clipped deep q-learning loss, only action_pos carries a target */
+        double err_clip_val = DQL_ERROR_CLIP_VALUE;
+
+        const output_t& out = std::get<num_layers - 1>(Z);
+        output_t& out_G = std::get<num_layers - 1>(G);
+
+        out_G = yj.array().square().matrix();
+
+        double err = std::min(std::max(yj(0, action_pos) - out(0, action_pos), -err_clip_val), err_clip_val);
+        out_G(0, action_pos) = err * err;
+
+        backward_layer<num_layers - 2>();
+    }
+
+    void update_weights()
+    {
+        update_layer<0>();
+    }
+
+    /* LOADING AND SAVING WEIGHTS */
+
+    /**
+     * @brief Copy the weights of a dynamic MLP of the same topology into this network.
+     *
+     * @param net
+     */
+    void copy_weights_from(const MLP* net)
+    {
+        if(net->num_layers != num_layers)
+        {
+            std::cerr << "MLP layout does not match StaticMLP layout, cannot copy weights!\n";
+            return;
+        }
+
+        copy_from_layer<0>(net);
+    }
+
+    /**
+     * @brief Copy the weights of this network into a dynamic MLP of the same topology.
+     *
+     * @param net
+     */
+    void copy_weights_to(MLP* net) const
+    {
+        if(net->num_layers != num_layers)
+        {
+            std::cerr << "MLP layout does not match StaticMLP layout, cannot copy weights!\n";
+            return;
+        }
+
+        copy_to_layer<0>(net);
+    }
+
+private:
+
+    template<std::size_t I>
+    void init_weights(weight_init_func_t& initialiser, rand_helper* rnd)
+    {
+        if constexpr(I < (num_layers - 1))
+        {
+            // initialisers work on dynamic matrices, fan in follows MLP
+            Eigen::MatrixXd tmp = Eigen::MatrixXd::Zero(layer_sizes[I], layer_sizes[I+1]);
+
+            if(initialiser != NULL)
+            {
+                int fan_in = (I == 0) ? 1 : layer_sizes[I-1];
+                initialiser(tmp, fan_in, layer_sizes[I+1], rnd);
+            }
+            else
+            {
+                rnd->fill_double_range(tmp.data(), tmp.size(), -1.0, 1.0);
+            }
+
+            std::get<I>(W) = tmp;
+            init_weights<I+1>(initialiser, rnd);
+        }
+    }
+
+    template<std::size_t I>
+    void forward_layer()
+    {
+        if constexpr(I < num_layers)
+        {
+            // weighted sum of previous layer plus bias
+            row_t<I> S = std::get<I-1>(Z) * std::get<I-1>(W);
+            S.array() += DEFAULT_BIAS;
+
+            if constexpr(I == (num_layers - 1))
+                mlp_activate<output_activation>(S, std::get<I>(Z), std::get<I>(Fp));
+            else
+                mlp_activate<hidden_activation>(S, std::get<I>(Z), std::get<I>(Fp));
+
+            forward_layer<I+1>();
+        }
+    }
+
+    template<std::size_t I>
+    void infer_layer(inference_scratch_t& scratch) const
+    {
+        if constexpr(I < num_layers)
+        {
+            row_t<I>& out = std::get<I>(scratch.Z);
+
+            out.noalias() = std::get<I-1>(scratch.Z) * std::get<I-1>(W);
+            out.array() += DEFAULT_BIAS;
+
+            if constexpr(I == (num_layers - 1))
+                mlp_activate_value<output_activation>(out);
+            else
+                mlp_activate_value<hidden_activation>(out);
+
+            infer_layer<I+1>(scratch);
+        }
+    }
+
+    template<std::size_t I>
+    void backward_layer()
+    {
+        if constexpr(I > 0)
+        {
+            std::get<I>(G) = (std::get<I+1>(G) * std::get<I>(W).transpose()).cwiseProduct(std::get<I>(Fp));
+            backward_layer<I-1>();
+        }
+    }
+
+    template<std::size_t I>
+    void update_layer()
+    {
+        if constexpr(I < (num_layers - 1))
+        {
+            std::get<I>(W).noalias() -= learning_rate * (std::get<I>(Z).transpose() * std::get<I+1>(G));
+            update_layer<I+1>();
+        }
+    }
+
+    template<std::size_t I>
+    void copy_from_layer(const MLP* net)
+    {
+        if constexpr(I < (num_layers - 1))
+        {
+            std::get<I>(W) = net->layers[I]->W;
+            copy_from_layer<I+1>(net);
+        }
+    }
+
+    template<std::size_t I>
+    void copy_to_layer(MLP* net) const
+    {
+        if constexpr(I < (num_layers - 1))
+        {
+            net->layers[I]->W = std::get<I>(W);
+            copy_to_layer<I+1>(net);
+        }
+    }
+};
+
+
+/* LOADING AND SAVING WEIGHTS - same text format as MLP, files are interchangeable between the two */
+
+
+template<int... Sizes>
+void save_weights(const StaticMLP<Sizes...>* net, const std::string& filename)
+{
+    std::ofstream output_file(filename.c_str());
+
+    if(!(output_file.is_open()))
+    {
+        std::cerr << "FILENAME ENTERED IS NOT VALID! CANNOT WRITE NETWORK TO FILE\n";
+        return;
+    }
+
+    /* file opened successfully */
+    std::apply([&output_file](const auto&... w)
+    {
+        auto write_layer = [&output_file](const auto& mat)
+        {
+            for(auto const& r : mat.rowwise())
+            {
+                for(auto const& v : r)
+                    output_file << v << '\n';
+            }
+            output_file << "<br>\n"; /* helper to reconstruct network*/
+        };
+
+        (write_layer(w), ...);
+    }, net->W);
+
+    // output layer has no weights
+    output_file << "<br>\n";
+
+    output_file.close();
+}
+
+
+template<int... Sizes>
+void load_weights(StaticMLP<Sizes...>* net, const std::string& filename)
+{
+    std::ifstream input_file(filename.c_str());
+
+    if(!(input_file.is_open()))
+    {
+        std::cerr << "FILENAME ENTERED IS NOT VALID! CANNOT READ NETWORK FROM FILE\n";
+        return;
+    }
+
+    /* file open success - read each <br> seperated layer */
+    std::vector<std::vector<double>> layer_vals(1);
+
+    std::string line;
+    while(getline(input_file, line))
+    {
+        if(!(strcmp(line.c_str(), "<br>")))
+        {
+            layer_vals.emplace_back();
+            continue;
+        }
+
+        layer_vals.back().push_back(std::stod(line));
+    }
+
+    input_file.close();
+
+    std::apply([&layer_vals](auto&... w)
+    {
+        int layer_pos = 0;
+
+        auto read_layer = [&layer_vals, &layer_pos](auto& mat)
+        {
+            const std::vector<double>& vals = layer_vals[layer_pos++];
+
+            if(vals.size() != mat.size())
+            {
+                std::cerr << "WEIGHTS FILE DOES NOT MATCH NETWORK LAYOUT! LAYER " << (layer_pos - 1) << " NOT LOADED\n";
+                return;
+            }
+
+            // weights are saved row by row
+            int r, c, pos = 0;
+            for(r = 0; r < mat.rows(); r++)
+                for(c = 0; c < mat.cols(); c++)
+                    mat(r, c) = vals[pos++];
+        };
+
+        if(layer_vals.size() < sizeof...(w))
+        {
+            std::cerr << "WEIGHTS FILE DOES NOT MATCH NETWORK LAYOUT! CANNOT READ NETWORK FROM FILE\n";
+            return;
+        }
+
+        (read_layer(w), ...);
+    }, net->W);
+
+    return;
+}
+
+
+#endif /* STATIC_NETWORK_H */
@@ -0,0 +1,65 @@
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+
+/**
+ * @brief Fixed size pool of worker threads running parallel_for loops. The calling thread takes part in every loop so a
+ * pool of size n starts n - 1 workers, a pool of size 1 runs everything on the calling thread.
+ * Dispatching a loop does no heap allocation as long as the task fits in std::function's small buffer (e.g. a lambda capturing this).
+ */
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+
+    /* current loop */
+    const std::function<void(int)>* task;
+    int num_tasks;
+    std::atomic<int> next_task;
+
+    /* workers still inside the current loop */
+    int active;
+
+    /* incremented for every loop so workers know there is new work */
+    unsigned long generation;
+    bool stopping;
+
+    std::mutex mtx;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+
+    void run();
+
+    /* take tasks from the current loop until there are none left */
+    void work();
+
+public:
+    ThreadPool(int num_threads);
+
+    ~ThreadPool();
+
+    /**
+     * @brief Number of threads taking part in a loop, including the calling thread.
+     */
+    int size() const { return workers.size() + 1; };
+
+    /**
+     * @brief Run task(i) for every i in [0, num_tasks) across the pool and block until all have finished.
+     * Tasks are handed out dynamically so no assumption should be made about which thread runs which i.
+     * 
+     * @param num_tasks 
+     * @param task 
+     */
+    void parallel_for(int num_tasks, const std::function<void(int)>& task);
+};
+
+
+#endif /* THREAD_POOL_H */
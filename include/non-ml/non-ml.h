@@ -19,11 +19,16 @@
 
 #include "utils/utils.h"
 #include "utils/rand_helper.h"
+#include "utils/eval_cache.h"
 
 
 std::vector<std::string> iterative_optimiser(const std::string& program_name, const std::vector<std::string>& action_space);
 
-std::vector<std::string> random_optimiser(const std::string& program_name, const std::vector<std::string>& action_space, const std::string& baseline, int iterations, rand_helper* rnd_helper);
+/**
+ * @brief Best of iterations random subsets of action_space. With an eval_cache, subsets already timed (in any order, by any
+ * optimiser) are not compiled again.
+ */
+std::vector<std::string> random_optimiser(const std::string& program_name, const std::vector<std::string>& action_space, const std::string& baseline, int iterations, rand_helper* rnd_helper, EvalCache* eval_cache=NULL);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,41 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 18/06/2024
+ * FILE LAST UPDATED: 18/06/2024
+ *
+ * REQUIREMENTS: GNU ld (--wrap)
+ * REFERENCES:
+ *
+ * DESCRIPTION: Heap allocation counter for the allocation checks and benchmarks.
+*/
+
+
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+
+/*
+ * Eigen allocates its matrices with std::malloc (or posix_memalign/aligned_alloc when it needs more alignment than malloc
+ * gives), never with operator new, so counting operator new alone misses them. The counter wraps the C allocation
+ * functions at link time as well as replacing operator new, so any binary linking alloc_counter.o must also be linked
+ * with:
+ *
+ *  -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free,--wrap=posix_memalign,--wrap=aligned_alloc
+ *
+ * (ALLOC_COUNTER_LINK_FLAGS in the Makefile), otherwise the link fails on the __real_* symbols. Only calls made from the
+ * objects in that link are wrapped, which includes all of mlp-cpp and Eigen (header only) but not allocations made inside
+ * shared libraries such as libstdc++ itself.
+ */
+
+
+/**
+ * @brief Number of heap allocations (malloc, calloc, posix_memalign, aligned_alloc, operator new and realloc of NULL)
+ * made since the program started, from any thread. Take the difference of two calls to count the allocations in between.
+ *
+ * @return unsigned long
+ */
+unsigned long get_num_allocations();
+
+
+#endif
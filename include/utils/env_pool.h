@@ -0,0 +1,92 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 12/06/2024
+ * FILE LAST UPDATED: 12/06/2024
+ *
+ * REQUIREMENTS: PolyBench
+ * REFERENCES:
+ *
+ * DESCRIPTION: Pool of PolyBench environments that can be compiled, run and have their state extracted concurrently.
+*/
+
+
+#ifndef ENV_POOL_H
+#define ENV_POOL_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "utils/utils.h"
+#include "utils/eval_cache.h"
+#include "utils/feature_cache.h"
+#include "mlp-cpp/thread_pool.h"
+
+#define DEFAULT_SCRATCH_LOCATION "bin/tmp/env" /* environment i works in DEFAULT_SCRATCH_LOCATION<i>/ */
+
+
+/**
+ * @brief Fixed number of PolyString environments, each with its own scratch folder for its executable and statetool
+ * output, and a thread per environment to step them on. Environments only share the read only benchmark sources, so
+ * any number of them can be compiled and run at the same time.
+ */
+class EnvironmentPool
+{
+private:
+    std::vector<PolyString*> envs;
+    std::vector<std::string> scratch_dirs;
+
+    ThreadPool* workers;
+
+public:
+    /**
+     * @brief Create num_envs environments on program_name, making (once) a scratch folder for each.
+     *
+     * @param num_envs
+     * @param program_name
+     * @param baseline
+     */
+    EnvironmentPool(const int num_envs, const std::string& program_name, const std::string& baseline);
+
+    ~EnvironmentPool();
+
+    inline int size() const { return envs.size(); };
+
+    inline PolyString* get_env(const int i) { return envs[i]; };
+
+    inline const std::string& get_scratch_dir(const int i) const { return scratch_dirs[i]; };
+
+    /**
+     * @brief Run task(i) for each of the first num_envs environments at the same time, blocking until all have finished.
+     * Task i may only use environment i.
+     *
+     * @param num_envs
+     * @param task
+     */
+    void for_each_env(const int num_envs, const std::function<void(int)>& task);
+
+    /**
+     * @brief Min max scaled program states of the first num_envs environments, extracted concurrently.
+     *
+     * @param num_envs
+     * @param num_features
+     * @param states out, states[i] for environment i
+     * @param feature_cache if not NULL, states already extracted are taken from the cache
+     */
+    void get_states(const int num_envs, const int num_features, std::vector<std::vector<double>>& states, FeatureCache* feature_cache=NULL);
+
+    /**
+     * @brief Runtimes of the first num_envs environments with their optimisations applied (or at -O0 when unoptimised
+     * is set), compiled and run concurrently.
+     *
+     * @param num_envs
+     * @param unoptimised
+     * @param runtimes out, runtimes[i] for environment i
+     * @param eval_cache if not NULL, runtimes already measured are taken from the cache
+     */
+    void get_runtimes(const int num_envs, bool unoptimised, std::vector<double>& runtimes, EvalCache* eval_cache=NULL);
+};
+
+
+#endif
@@ -0,0 +1,136 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 14/06/2024
+ * FILE LAST UPDATED: 14/06/2024
+ *
+ * REQUIREMENTS: PolyBench
+ * REFERENCES:
+ *
+ * DESCRIPTION: Persistent cache of measured program runtimes, shared by every optimiser.
+*/
+
+
+#ifndef EVAL_CACHE_H
+#define EVAL_CACHE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <mutex>
+
+#include "utils/utils.h"
+
+#define DEFAULT_EVAL_CACHE_LOCATION "data/eval_cache.tsv"
+#define DEFAULT_EVAL_CACHE_SAMPLES 1 /* runtime samples a flag set needs before it is reused rather than measured again */
+#define DEFAULT_DATASET_SIZE "STANDARD_DATASET" /* PolyBench's dataset when no -D<SIZE>_DATASET flag is given */
+
+
+/* EVALUATION CACHE FORMAT */
+
+/*
+ * A text file with one runtime sample per line, appended to as samples are measured:
+ *
+ *  program \t compiler version \t baseline \t dataset size \t flags \t runtime
+ *
+ * flags is the canonical flag set: sorted, duplicates and empty (NOP) flags removed, separated by single spaces. The
+ * dataset size is taken out of the flags. Lines that do not parse, e.g. one cut short by a crash, are skipped.
+ */
+
+
+/**
+ * @brief Runtimes keyed by (program, compiler version, baseline, canonical flag set, dataset size). A key is measured
+ * until it has min_samples runtime samples and from then on answered with their mean without compiling anything.
+ * Samples are written to the cache file as they are measured so later runs (of any optimiser) reuse them. Safe to use
+ * from several threads, e.g. the environments of an EnvironmentPool.
+ */
+class EvalCache
+{
+private:
+    std::string filename;
+    std::ofstream out_file;
+
+    unsigned int min_samples;
+
+    std::unordered_map<std::string, std::vector<double>> samples;
+
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long num_loaded;
+
+    std::mutex mtx;
+
+    void load();
+
+public:
+    /**
+     * @brief Load the samples in filename and append new ones to it, an empty filename keeps the cache in memory only.
+     *
+     * @param filename
+     * @param min_samples
+     */
+    EvalCache(const std::string& filename=DEFAULT_EVAL_CACHE_LOCATION, const unsigned int min_samples=DEFAULT_EVAL_CACHE_SAMPLES);
+
+    ~EvalCache() { };
+
+    /**
+     * @brief Sorted flags without duplicates or empty flags, joined by spaces. dataset is set to the -D<SIZE>_DATASET flag
+     * if one is given (it is not included in the returned flags), DEFAULT_DATASET_SIZE otherwise.
+     *
+     * @param flags
+     * @param dataset out
+     * @return std::string
+     */
+    static std::string canonical_flags(const std::vector<std::string>& flags, std::string& dataset);
+
+    /**
+     * @brief Cache key of program_name compiled by POLY_COMPILER with baseline and flags, tab separated as in the cache file.
+     * The compiler is asked for its version the first time a key is made.
+     *
+     * @param program_name
+     * @param baseline
+     * @param flags in any order
+     * @return std::string
+     */
+    static std::string make_key(const std::string& program_name, const std::string& baseline, const std::vector<std::string>& flags);
+
+    /**
+     * @brief Runtime of program_name compiled with baseline and flags: the mean of the cached samples if there are at
+     * least min_samples, otherwise compile_string is run (see run_given_string) and its runtime added as a new sample.
+     * Failed runs (-1) are returned but never cached.
+     *
+     * @param compile_string
+     * @param program_name
+     * @param baseline
+     * @param flags in any order
+     * @param exec_location folder compile_string outputs the program to
+     * @return double
+     */
+    double get_runtime(const std::string& compile_string, const std::string& program_name, const std::string& baseline, const std::vector<std::string>& flags, const std::string& exec_location=DEFAULT_EXEC_OUTPUT_LOCATION);
+
+    /**
+     * @brief get_runtime of an environment with its optimisations applied, or at -O0 without any when unoptimised is set.
+     *
+     * @param ps
+     * @param unoptimised
+     * @return double
+     */
+    double get_runtime(PolyString* ps, bool unoptimised);
+
+    inline unsigned long get_hits() const { return hits; };
+
+    inline unsigned long get_misses() const { return misses; };
+
+    /**
+     * @brief Number of keys with at least one sample.
+     */
+    inline std::size_t size() const { return samples.size(); };
+
+    inline bool is_persistent() const { return out_file.is_open(); };
+
+    void print_stats();
+};
+
+
+#endif
@@ -0,0 +1,95 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 16/06/2024
+ * FILE LAST UPDATED: 16/06/2024
+ *
+ * REQUIREMENTS: PolyBench, statetool
+ * REFERENCES:
+ *
+ * DESCRIPTION: Cache of statetool program states so each distinct state is only compiled for once.
+*/
+
+
+#ifndef FEATURE_CACHE_H
+#define FEATURE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <mutex>
+
+#include "utils/utils.h"
+#include "utils/eval_cache.h"
+
+#define DEFAULT_FEATURE_CACHE_LOCATION "data/feature_cache.tsv"
+
+
+/* FEATURE CACHE FORMAT */
+
+/*
+ * A text file with one program state per line, appended to as states are extracted:
+ *
+ *  program \t compiler version \t baseline \t dataset size \t flags \t features
+ *
+ * The key fields are those of EvalCache::make_key, features are the raw (unscaled) statetool values separated by single
+ * spaces. Lines that do not parse are skipped.
+ */
+
+
+/**
+ * @brief Program states keyed by EvalCache::make_key, held in memory and optionally persisted to a file that later runs
+ * load. A program's state only depends on its flag set, so asking again for a state (the next state of one step is the
+ * current state of the next, an already applied action leaves the flags as they were) never compiles again. Safe to use
+ * from several threads.
+ */
+class FeatureCache
+{
+private:
+    std::string filename;
+    std::ofstream out_file;
+
+    std::unordered_map<std::string, std::vector<double>> states;
+
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long num_loaded;
+
+    std::mutex mtx;
+
+    void load();
+
+public:
+    /**
+     * @brief Load the states in filename and append new ones to it, an empty filename keeps the cache in memory only.
+     *
+     * @param filename
+     */
+    FeatureCache(const std::string& filename="");
+
+    ~FeatureCache() { };
+
+    /**
+     * @brief get_program_state of ps, compiling with statetool only if its flag set has not been seen. States that fail
+     * to extract (not num_features long) are returned but never cached.
+     *
+     * @param ps
+     * @param num_features
+     * @return std::vector<double>
+     */
+    std::vector<double> get_program_state(PolyString* ps, int num_features);
+
+    inline unsigned long get_hits() const { return hits; };
+
+    inline unsigned long get_misses() const { return misses; };
+
+    inline std::size_t size() const { return states.size(); };
+
+    inline bool is_persistent() const { return out_file.is_open(); };
+
+    void print_stats();
+};
+
+
+#endif
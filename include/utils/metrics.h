@@ -0,0 +1,166 @@
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/* BINARY METRICS LOG FORMAT */
+
+/*
+ * Layout of a metrics log, all integers little endian as written by the host:
+ *
+ *  metrics_file_header_t
+ *  blocks, each a metrics_block_header_t followed by its payload:
+ *      METRICS_BLOCK_NAME  - uint32 metric id, then count bytes of metric name (no terminator)
+ *      METRICS_BLOCK_DATA  - count records stored by column: uint32 ids[count], uint64 steps[count], double values[count]
+ *
+ * A metric's name block is always written before any data block using its id. A log cut short by a crash is readable
+ * up to its last complete block. visualisations/metrics_reader.py reads this format into pandas.
+ */
+
+#define METRICS_MAGIC "DRLGCCM"
+#define METRICS_VERSION 1
+
+#define DEFAULT_METRICS_CAPACITY 4096 /* records, rounded up to a power of two */
+#define DEFAULT_METRICS_DRAIN_MS 200
+
+enum metrics_block_t
+{
+    METRICS_BLOCK_NAME = 0,
+    METRICS_BLOCK_DATA = 1
+};
+
+struct metrics_file_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct metrics_block_header_t
+{
+    uint32_t type;
+    uint32_t count;
+};
+
+
+/* METRICS SINK */
+
+/**
+ * @brief Buffered telemetry log. record() copies a (metric, step, value) triple into a lock free single producer ring
+ * and returns, a background thread wakes every drain_ms milliseconds and appends everything queued to the log as one
+ * columnar block. The training thread never formats, writes or flushes. If the ring fills up before the writer catches up
+ * new records are dropped and counted rather than blocking the producer.
+ * record() must only be called from one thread at a time.
+ */
+class MetricsSink
+{
+private:
+    struct record_t
+    {
+        uint32_t metric_id;
+        uint64_t step;
+        double value;
+    };
+
+    /* ring buffer, head is only written by the producer and tail only by the writer thread */
+    std::vector<record_t> ring;
+    uint64_t mask;
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+
+    unsigned long dropped;
+
+    /* names of registered metrics, position is the metric id */
+    std::vector<std::string> names;
+    int names_written;
+
+    /* columns of the block being written, reused between drains */
+    std::vector<uint32_t> ids_col;
+    std::vector<uint64_t> steps_col;
+    std::vector<double> values_col;
+
+    std::ofstream file;
+    int drain_ms;
+
+    uint64_t written; /* records written to the file */
+    bool flush_requested;
+    bool stopping;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread worker;
+
+    void run();
+
+    void drain();
+
+public:
+    /**
+     * @brief Open (truncate) filename and start the writer thread, check is_open before recording.
+     *
+     * @param filename
+     * @param capacity records the ring can hold before new records are dropped
+     * @param drain_ms
+     */
+    MetricsSink(const std::string& filename, int capacity = DEFAULT_METRICS_CAPACITY, int drain_ms = DEFAULT_METRICS_DRAIN_MS);
+
+    /**
+     * @brief Writes every queued record before closing the log.
+     */
+    ~MetricsSink();
+
+    bool is_open() const { return file.is_open(); };
+
+    /**
+     * @brief Register a metric name, returning the id passed to record. Registering an existing name returns its id.
+     *
+     * @param name
+     * @return int
+     */
+    int register_metric(const std::string& name);
+
+    /**
+     * @brief Queue a value, wait free and allocation free.
+     *
+     * @param metric_id from register_metric
+     * @param step x axis of the value, e.g. the training step
+     * @param value
+     * @return true if queued, false if the ring was full and the value was dropped
+     */
+    bool record(int metric_id, uint64_t step, double value)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+
+        if((h - tail.load(std::memory_order_acquire)) > mask)
+        {
+            dropped++;
+            return false;
+        }
+
+        ring[h & mask] = {(uint32_t)metric_id, step, value};
+        head.store(h + 1, std::memory_order_release);
+
+        return true;
+    };
+
+    /**
+     * @brief Block until everything recorded so far is in the log.
+     */
+    void flush();
+
+    /**
+     * @brief Number of records dropped because the ring was full, only read from the producer thread.
+     */
+    unsigned long get_dropped() const { return dropped; };
+};
+
+
+#endif /* METRICS_H */
@@ -0,0 +1,82 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 10/06/2024
+ * FILE LAST UPDATED: 10/06/2024
+ *
+ * REQUIREMENTS: POSIX (posix_spawn, wait4)
+ * REFERENCES:
+ *
+ * DESCRIPTION: Runs compilers and benchmarks as child processes directly, without a shell in between.
+*/
+
+
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <string>
+#include <vector>
+
+
+/**
+ * @brief How a child process finished, and what it cost.
+ */
+struct process_result_t
+{
+    /* false if the process could not be started at all */
+    bool spawned;
+
+    /* exit code when the process exited normally, -1 otherwise (e.g. killed by a signal) */
+    int exit_status;
+
+    /* signal that terminated the process, 0 if it exited */
+    int term_signal;
+
+    /* from the child's rusage, seconds */
+    double user_time;
+    double sys_time;
+
+    /* peak resident set size of the child, kilobytes */
+    long max_rss_kb;
+
+    /* the child's stdout, only filled when captured */
+    std::string output;
+
+    process_result_t() : spawned(false), exit_status(-1), term_signal(0), user_time(0), sys_time(0), max_rss_kb(0) { };
+
+    inline bool succeeded() const { return spawned && (exit_status == 0); };
+};
+
+
+/**
+ * @brief Split a command line on whitespace into an argv vector. There is no shell, so quotes, redirection and
+ * globbing are not interpreted; the PolyString command lines never use them.
+ *
+ * @param command
+ * @return std::vector<std::string>
+ */
+std::vector<std::string> split_command(const std::string& command);
+
+/**
+ * @brief Run argv[0] (searched for in PATH) with argv and wait for it. stdin is /dev/null, stderr is inherited. stdout
+ * is read through a pipe into result.output when capture_output is set, otherwise it is inherited.
+ *
+ * @param argv
+ * @param result out
+ * @param capture_output
+ * @return result.succeeded()
+ */
+bool run_process(const std::vector<std::string>& argv, process_result_t& result, bool capture_output=false);
+
+/**
+ * @brief split_command then run_process.
+ *
+ * @param command
+ * @param result out
+ * @param capture_output
+ * @return result.succeeded()
+ */
+bool run_command(const std::string& command, process_result_t& result, bool capture_output=false);
+
+
+#endif
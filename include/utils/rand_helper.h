@@ -3,7 +3,9 @@
  * LICENSE: Shipped with package - GNU GPL v3.0
  * FILE START: 27/04/2024
  * FILE LAST UPDATED: 09/05/2024
- * 
+ *
+ * REFERENCES: John K. Salmon et al. "Parallel random numbers: as easy as 1, 2, 3." (Philox4x32-10)
+ *
  * DESCRIPTION: Class definition and implementation for random distributions.
 */
 
@@ -12,77 +14,263 @@
 
 #include <algorithm>
 #include <random>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
 
 #define RAND_SEED 12
 
+/* ROUNDS OF THE PHILOX BIJECTION, 10 PASSES BIGCRUSH */
+#define PHILOX_ROUNDS 10
+
+/*
+ * Counter based generator: output block n of a stream is Philox4x32-10(key, {n, stream id}), the key comes from the
+ * seed. Any position of any stream can be computed directly, so streams need no shared state and never overlap, a
+ * sub stream only differs from its parent in the stream id and skip is a counter addition.
+ */
 class rand_helper
 {
-    std::mt19937 gn;
-    std::default_random_engine rng;
+    uint32_t key[2];
+    uint64_t stream;
+    uint64_t counter; /* next block to generate */
+
+    /* the current block of four outputs, block_pos of them used */
+    uint32_t block[4];
+    int block_pos;
+
+    /* second value of the last Box-Muller pair */
+    bool has_spare_normal;
+    double spare_normal;
+
+    static uint64_t splitmix64(uint64_t x)
+    {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    };
+
+    void generate_block()
+    {
+        uint32_t ctr[4] = {(uint32_t)counter, (uint32_t)(counter >> 32), (uint32_t)stream, (uint32_t)(stream >> 32)};
+        uint32_t k[2] = {key[0], key[1]};
+
+        int r;
+        for(r = 0; r < PHILOX_ROUNDS; r++)
+        {
+            uint64_t p0 = (uint64_t)0xD2511F53 * ctr[0];
+            uint64_t p1 = (uint64_t)0xCD9E8D57 * ctr[2];
+
+            uint32_t next[4] = {(uint32_t)(p1 >> 32) ^ ctr[1] ^ k[0], (uint32_t)p1, (uint32_t)(p0 >> 32) ^ ctr[3] ^ k[1], (uint32_t)p0};
+            std::copy(next, next + 4, ctr);
+
+            k[0] += 0x9E3779B9;
+            k[1] += 0xBB67AE85;
+        }
+
+        std::copy(ctr, ctr + 4, block);
+        block_pos = 0;
+        counter++;
+    };
+
+    void seed_key(uint64_t seed)
+    {
+        uint64_t k = splitmix64(seed);
+        key[0] = (uint32_t)k;
+        key[1] = (uint32_t)(k >> 32);
+    };
 
 public:
+    /* usable as a UniformRandomBitGenerator with the standard library */
+    typedef uint32_t result_type;
+
+    static constexpr result_type min() { return 0; };
+    static constexpr result_type max() { return UINT32_MAX; };
+
     /**
      * @brief Construct a new rand_helper object with rand_helper defined seed RAND_SEED.
     */
     rand_helper()
+    : rand_helper(RAND_SEED)
     {
-        std::random_device rd;
-
-        std::mt19937 generator(rd());
-        gn = generator;
-
-        /* seeding */
-        gn.seed(RAND_SEED);
-        srand(RAND_SEED);
-
         return;
     };
 
     /**
      * @brief Construct a new rand helper object with user defined seed passed as argument.
-     * 
+     *
      * @param SEED integer seed value.
      */
     rand_helper(const int SEED)
+    : stream(0), counter(0), block_pos(4), has_spare_normal(false), spare_normal(0.0)
     {
-        std::random_device rd;
+        /* seeding */
+        seed_key((uint64_t)SEED);
 
-        std::mt19937 generator(rd());
-        gn = generator;
+        return;
+    }
 
-        /* seeding */
-        gn.seed(SEED);
-        srand(SEED);
+    /**
+     * @brief Construct an independent sub stream of parent, e.g. one per thread, environment or network. The same parent
+     * seed and stream_id always give the same sequence, whatever has been drawn from the parent or from other streams.
+     * Sub streams can be split again.
+     *
+     * @param parent
+     * @param stream_id
+     */
+    rand_helper(const rand_helper& parent, const uint64_t stream_id)
+    : stream(splitmix64(splitmix64(parent.stream) + stream_id)), counter(0), block_pos(4), has_spare_normal(false), spare_normal(0.0)
+    {
+        key[0] = parent.key[0];
+        key[1] = parent.key[1];
 
         return;
     }
 
     ~rand_helper(){};
 
+    /**
+     * @brief Next 32 random bits.
+     */
+    result_type operator()()
+    {
+        if(block_pos == 4)
+            generate_block();
+
+        return block[block_pos++];
+    };
+
+    uint64_t next_u64()
+    {
+        uint64_t lo = (*this)();
+        return (((uint64_t)(*this)()) << 32) | lo;
+    };
+
+    /**
+     * @brief Jump ahead n 32 bit outputs without generating them.
+     *
+     * @param n
+     */
+    void skip(const uint64_t n)
+    {
+        uint64_t pos = (counter * 4) - (4 - block_pos) + n;
+
+        counter = pos / 4;
+        block_pos = 4;
+
+        if(pos % 4)
+        {
+            generate_block();
+            block_pos = pos % 4;
+        }
+
+        has_spare_normal = false;
+    };
+
     int random_int_range(const int range_from, const int range_to)
     {
-        std::uniform_int_distribution<int> distr(range_from, range_to);
-        return distr(gn);
+        // Lemire's multiply and reject, unbiased and usually without a division
+        uint64_t span = (uint64_t)((int64_t)range_to - (int64_t)range_from) + 1;
+
+        if(span > UINT32_MAX)
+            return (int)(*this)();
+
+        uint64_t m = (uint64_t)(*this)() * span;
+
+        if((uint32_t)m < span)
+        {
+            uint32_t threshold = (uint32_t)((0x100000000ULL - span) % span);
+
+            while((uint32_t)m < threshold)
+                m = (uint64_t)(*this)() * span;
+        }
+
+        return (int)((int64_t)range_from + (int64_t)(m >> 32));
     };
 
     double random_double_range(const double range_from, const double range_to)
     {
-        std::uniform_real_distribution<double> distr(range_from, range_to);
-        return distr(gn);
+        // 53 random bits in [0, 1)
+        double u = (next_u64() >> 11) * 0x1.0p-53;
+        return range_from + (u * (range_to - range_from));
     }
 
     double normal_distribution(const double mean, const double sd)
     {
-        std::normal_distribution<double> distr(mean, sd);
-        return distr(gn);
+        if(has_spare_normal)
+        {
+            has_spare_normal = false;
+            return mean + (sd * spare_normal);
+        }
+
+        double z0, z1;
+        standard_normal_pair(z0, z1);
+
+        spare_normal = z1;
+        has_spare_normal = true;
+
+        return mean + (sd * z0);
+    }
+
+    /**
+     * @brief Two independent standard normal values (Box-Muller).
+     */
+    void standard_normal_pair(double& z0, double& z1)
+    {
+        // u1 in (0, 1] so the log is finite
+        double u1 = 1.0 - random_double_range(0.0, 1.0);
+        double u2 = random_double_range(0.0, 1.0);
+
+        double r = std::sqrt(-2.0 * std::log(u1));
+        double theta = 2.0 * M_PI * u2;
+
+        z0 = r * std::cos(theta);
+        z1 = r * std::sin(theta);
+    }
+
+    /* BATCHED FILLS - e.g. of initialiser matrices through Eigen's data(), or minibatch positions */
+
+    void fill_int_range(int* out, const std::size_t n, const int range_from, const int range_to)
+    {
+        std::size_t i;
+        for(i = 0; i < n; i++)
+            out[i] = random_int_range(range_from, range_to);
+    }
+
+    void fill_double_range(double* out, const std::size_t n, const double range_from, const double range_to)
+    {
+        std::size_t i;
+        for(i = 0; i < n; i++)
+            out[i] = random_double_range(range_from, range_to);
+    }
+
+    void fill_normal(double* out, const std::size_t n, const double mean, const double sd)
+    {
+        double z0, z1;
+
+        std::size_t i;
+        for(i = 0; (i + 1) < n; i += 2)
+        {
+            standard_normal_pair(z0, z1);
+            out[i] = mean + (sd * z0);
+            out[i+1] = mean + (sd * z1);
+        }
+
+        if(i < n)
+            out[i] = normal_distribution(mean, sd);
     }
 
     template<typename T>
     void rnd_shuffle(std::vector<T>& vec)
     {
-        std::shuffle(std::begin(vec), std::end(vec), gn);
+        // Fisher-Yates with this generator's own ranges so shuffles match across standard libraries
+        int i;
+        for(i = (int)vec.size() - 1; i > 0; i--)
+            std::swap(vec[i], vec[random_int_range(0, i)]);
+
         return;
     }
 };
 
-#endif /* RAND_HELPER_H */
\ No newline at end of file
+#endif /* RAND_HELPER_H */
@@ -18,10 +18,13 @@
 #define DEFAULT_BENCHMARKS_LIST_LOCATION "data/benchmark_list.txt"
 
 #define DEFAULT_EXEC_OUTPUT_LOCATION "bin/tmp/"
-#define DEFAULT_DATA_OUTPUT_LOCATION "data/tmp/tmpXX"
-#define DEFAULT_PLUGIN_OUTPUT_LOCATION "data/tmp/statetmpXX.txt"
+#define DEFAULT_POLYBENCH_OBJECT_LOCATION "bin/polybench/" /* prebuilt polybench.c objects, kept between runs */
+#define POLYBENCH_UTILITIES_SOURCE "polybench-c-3.2/utilities/polybench.c"
+#define DEFAULT_PLUGIN_OUTPUT_FILENAME "statetmpXX.txt"
+#define DEFAULT_PLUGIN_OUTPUT_LOCATION "data/tmp/" DEFAULT_PLUGIN_OUTPUT_FILENAME
 
-#define DEFAULT_PLUGIN_INFO "-fplugin=./statetool.dylib -fplugin-arg-statetool.dylib-filename=" DEFAULT_PLUGIN_OUTPUT_LOCATION
+#define DEFAULT_PLUGIN_ARGS "-fplugin=./statetool.dylib -fplugin-arg-statetool.dylib-filename="
+#define DEFAULT_PLUGIN_INFO DEFAULT_PLUGIN_ARGS DEFAULT_PLUGIN_OUTPUT_LOCATION
 
 #define POLY_COMPILER "gcc"
 
@@ -31,6 +34,10 @@
 #include <filesystem>
 #include <fstream>
 #include <cmath>
+#include <sstream>
+#include <cstdio>
+
+#include "utils/process.h"
 
 
 /**
@@ -56,7 +63,11 @@ struct PolyString
     /* stored for easy use in performance timing functions */
     std::string program_name; 
 
-    PolyString(const std::string& program_name, const std::string& plugin_info, const std::string& output, const std::string& baseline);
+    /* folder the program is compiled into and file statetool writes the program state to, unique per environment when environments run concurrently */
+    std::string exec_location;
+    std::string plugin_output_location;
+
+    PolyString(const std::string& program_name, const std::string& plugin_info, const std::string& output, const std::string& baseline, const std::string& exec_location=DEFAULT_EXEC_OUTPUT_LOCATION, const std::string& plugin_output_location=DEFAULT_PLUGIN_OUTPUT_LOCATION);
 
     void reset_PolyString_optimisations();
 
@@ -88,18 +99,37 @@ struct PolyString
  * 
  * @param program_name 
  * @param baseline 
+ * @param scratch_dir if not empty, the (existing) folder the environment compiles into and writes program state to instead of the shared temp folders
  * @return PolyString* 
  */
-PolyString* construct_polybench_PolyString(const std::string& program_name, const std::string& baseline);
+PolyString* construct_polybench_PolyString(const std::string& program_name, const std::string& baseline, const std::string& scratch_dir="");
 
 /**
  * @brief Returns a string constructed with required polybench information for a correct compile string, function used within construct_polybench_PolyString.
+ * Only the kernel is compiled, the polybench utilities are linked in from get_polybench_object.
  * 
  * @param program_name 
  * @return std::string 
  */
 std::string get_benchmark_files(const std::string& program_name);
 
+/**
+ * @brief Path of polybench.c compiled by POLY_COMPILER with baseline, built the first time it is asked for and kept in
+ * DEFAULT_POLYBENCH_OBJECT_LOCATION (one object per compiler version and baseline) so compile strings only have to compile
+ * and link the kernel. Rebuilt if polybench.c is newer. Falls back to the source itself if the object can not be built.
+ * 
+ * @param baseline 
+ * @return std::string 
+ */
+std::string get_polybench_object(const std::string& baseline);
+
+/**
+ * @brief First line of POLY_COMPILER --version, e.g. gcc (GCC) 13.2.0, asked for once.
+ * 
+ * @return const std::string& 
+ */
+const std::string& get_compiler_version();
+
 /**
  * @brief Returns a string with necessary header information for a polybench compile string, used within construct_polybench_PolyString.
  * 
@@ -109,6 +139,14 @@ std::string get_benchmark_files(const std::string& program_name);
 std::string construct_header(const std::string& program_name);
 
 
+/**
+ * @brief Create the temp folders compiled programs and plugin output are written to, run once at startup.
+ *
+ * @return bool
+ */
+bool create_tmp_folders();
+
+
 /* FORMATTING HELPER FUNCTIONS */
 
 
@@ -156,13 +194,16 @@ int get_benchmark_location(const std::string& program_name);
 /* ANALYSIS FUNCTIONS */
 
 /**
- * @brief Runs a given (polybench) compile string and returns the number of seconds that the string takes to run.
+ * @brief Runs a given (polybench) compile string and returns the number of seconds that the string takes to run, -1 if
+ * it does not compile or run. The compiler and program are run directly rather than through a shell.
  * 
  * @param compile_string 
  * @param program_name 
+ * @param exec_location folder compile_string outputs the program to
+ * @param run_result if not NULL, set to the exit status and resource usage of the program run
  * @return double 
  */
-double run_given_string(const std::string& compile_string, const std::string& program_name);
+double run_given_string(const std::string& compile_string, const std::string& program_name, const std::string& exec_location=DEFAULT_EXEC_OUTPUT_LOCATION, process_result_t* run_result=NULL);
 
 /**
  * @brief Returns a state vector of the current environment by utilising the statetool plugin.
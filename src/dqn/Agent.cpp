@@ -29,7 +29,16 @@ Agent::Agent
     const double discount_rate,
     const double learning_rate,
     rand_helper* rnd,
-    bool gradient_monitoring
+    bool gradient_monitoring,
+    const unsigned int batch_size,
+    const agent_precision_t precision,
+    const mlp_optimiser_t optimiser,
+    const unsigned int num_threads,
+    const replay_sampling_t replay_sampling,
+    const std::string& replay_filename,
+    const replay_state_format_t replay_state_format,
+    const std::string& eval_cache_filename,
+    const std::string& feature_cache_filename
 )
 :
     actions(actions), /* setting agent's action space */
@@ -40,19 +49,59 @@ Agent::Agent
     episode_length(episode_length),
     discount_rate(discount_rate),
     learning_rate(learning_rate),
+    batch_size(batch_size),
+    num_threads(num_threads),
+    Q(NULL),
+    Q_hat(NULL),
+    Q_f(NULL),
+    Q_hat_f(NULL),
+    precision(precision),
+    optimiser(optimiser),
+    network_config(network_config),
+    replay_sampling(replay_sampling),
+    replay_filename(replay_filename),
+    replay_state_format(replay_state_format),
+    eval_cache(new EvalCache(eval_cache_filename)),
+    eval_cache_filename(eval_cache_filename),
+    feature_cache(new FeatureCache(feature_cache_filename)),
+    feature_cache_filename(feature_cache_filename),
+    checkpoint_writer(new CheckpointWriter()),
     rnd(rnd),
-    gradient_monitoring(gradient_monitoring)
+    gradient_monitoring(gradient_monitoring),
+    metrics(NULL),
+    train_step(0),
+    planned_train_steps(number_of_episodes * episode_length)
 {
     save_agent_information();
 
+    // independent random streams for each part of the agent
+    rand_helper network_rnd(*rnd, AGENT_STREAM_NETWORKS);
+    exploration_rnd = new rand_helper(*rnd, AGENT_STREAM_EXPLORATION);
+    sampling_rnd = new rand_helper(*rnd, AGENT_STREAM_SAMPLING);
+    environment_rnd = new rand_helper(*rnd, AGENT_STREAM_ENVIRONMENT);
+
     // creating activation func pair and initialisor
-    std::pair<mlp_activation_func_t, mlp_activation_func_t> activ_funcs = std::make_pair(DEFAULT_HIDDEN_ACTIVATION, DEFAULT_OUTPUT_ACTIVATION);
+    std::pair<mlp_activation_t, mlp_activation_t> activ_funcs = std::make_pair(DEFAULT_HIDDEN_ACTIVATION, DEFAULT_OUTPUT_ACTIVATION);
     weight_init_func_t initialiasor = DEFAULT_INITIALISOR;
     mlp_loss_func_t loss_func = DEFAULT_LOSS_FUNCTION;
 
-    // instatiate both networks
-    Q = new MLP(network_config, activ_funcs, initialiasor, loss_func, rnd, learning_rate);
-    Q_hat = new MLP(network_config, activ_funcs, initialiasor, loss_func, rnd, learning_rate);
+    // instatiate both networks in the chosen precision, only Q is trained so only Q keeps optimiser state
+    if(precision == AGENT_PRECISION_DOUBLE)
+        Q = new MLP(network_config, activ_funcs, initialiasor, loss_func, &network_rnd, learning_rate, optimiser);
+    else
+        Q_f = new MLPf(network_config, activ_funcs, initialiasor, loss_func, &network_rnd, learning_rate, optimiser);
+
+    if(precision == AGENT_PRECISION_FLOAT)
+        Q_hat_f = new MLPf(network_config, activ_funcs, initialiasor, loss_func, &network_rnd, learning_rate);
+    else
+        Q_hat = new MLP(network_config, activ_funcs, initialiasor, loss_func, &network_rnd, learning_rate);
+
+    // minibatches through Q and Q_hat are split across threads, only one of the networks runs at a time
+    if(num_threads > 0)
+    {
+        (Q != NULL) ? Q->set_num_threads(num_threads) : Q_f->set_num_threads(num_threads);
+        (Q_hat != NULL) ? Q_hat->set_num_threads(num_threads) : Q_hat_f->set_num_threads(num_threads);
+    }
 
     // set optimisation baseline
     optimisation_baseline = "-O1"; // changeable parameter based on action-space chosen
@@ -61,25 +110,47 @@ Agent::Agent
     // initially set network weights equal
     copy_network_weights();
 
-    // resize buffer and set curr pos
-    buff.resize(buffer_size);
-    curr_buff_pos = 0;
+    // replay buffer storage is allocated once up front, a replay store file keeps the transitions between runs
+    if(replay_filename.empty())
+    {
+        buff = new ReplayBuffer(buffer_size, get_num_features(), replay_state_format, replay_sampling);
+    }
+    else
+    {
+        buff = new ReplayBuffer(replay_filename, buffer_size, get_num_features(), ReplayBuffer::hash_action_space(actions), replay_state_format, replay_sampling);
+
+        if(!buff->empty())
+            std::cout << "Replay buffer warm started with " << buff->size() << " transitions (" << buff->num_unique_states() << " distinct states) from " << replay_filename << '\n';
+    }
 
     // resize applied_optimisations to size of action space - 1 in pos i represents optimisation i has been applied
     applied_optimisations.resize(actions.size());
 
-    // get no optimisations applied runtime
-    init_runtime = run_given_string(curr_env->get_no_plugin_no_optimisations_PolyString(), program_names[0]);
+    // measured once online training starts so offline training never compiles anything
+    init_runtime = 0;
 
-    // open gradient file in order for agent to write gradient to file
+    // open metrics log in order for agent to write the training loss and episode results to file
     if(gradient_monitoring)
     {
-        grad_monitor_file.open(GRADIENT_MONITOR_FILENAME);
+        metrics = new MetricsSink(METRICS_LOG_FILENAME);
 
-        if(!grad_monitor_file.is_open())
+        if(!metrics->is_open())
         {
             std::cerr << "Gradient monitoring file open unsuccesful!\n";
             std::cerr << "Monitoring will not take place.\n";
+
+            delete metrics;
+            metrics = NULL;
+        }
+        else
+        {
+            loss_metric = metrics->register_metric("loss");
+            init_runtime_metric = metrics->register_metric("initial_runtime");
+            runtime_metric = metrics->register_metric("runtime");
+            reward_metric = metrics->register_metric("episode_reward");
+            mean_max_q_metric = metrics->register_metric("mean_max_q");
+            mean_action_q_metric = metrics->register_metric("mean_action_q");
+            td_error_metric = metrics->register_metric("mean_abs_td_error");
         }
     }
 
@@ -93,9 +164,14 @@ void Agent::train_optimiser(const double epsilon)
     bool terminate;
     int curr_itr = 0;
 
+    planned_train_steps = train_step + (number_of_episodes * episode_length);
+
+    // get no optimisations applied runtime of the first program
+    init_runtime = eval_cache->get_runtime(curr_env, true);
+
     for(i = 0; i < number_of_episodes; i++)
     {
-        std::cout << "Episode: " << i << "\t Program: " << curr_env->program_name << "\t Training Progress: " << ((i+1) / (double)number_of_episodes) * 100 << "%\n" << std::flush;
+        std::cout << "Episode: " << i << "\t Program: " << curr_env->program_name << "\t Training Progress: " << ((i+1) / (double)number_of_episodes) * 100 << "%\n";
 
         for(j = 0; j < episode_length; j++)
         {
@@ -110,9 +186,9 @@ void Agent::train_optimiser(const double epsilon)
             if(!(curr_itr % copy_period))
                 copy_network_weights();
 
-            /* save network weights to file */
+            /* checkpoint network weights in the background */
             if(!(curr_itr % ((int)DEFAULT_SAVE_PERIOD)))
-                save_weights(Q, (std::string)DEFAULT_WEIGHT_SAVE_LOCATION);
+                save_checkpoint_async((std::string)DEFAULT_CHECKPOINT_LOCATION);
 
             curr_itr++;
         }
@@ -123,23 +199,33 @@ void Agent::train_optimiser(const double epsilon)
         std::cout << "Optimisations applied in episode: ";
         for(auto const& opt : curr_env->optimisations)
             std::cout << opt << " ";
-        std::cout << "\n\n" << std::flush;
+        std::cout << "\n\n";
 
         // reset the environment with a uniformally chosen new program, regenerate the initial runtime for the new chosen program, and reset applied optimisations
-        int program_pos = rnd->random_int_range(0, program_names.size()-1);
+        int program_pos = environment_rnd->random_int_range(0, program_names.size()-1);
 
         curr_env->reset_PolyString_environment(program_names[program_pos]);
 
-        init_runtime = run_given_string(curr_env->get_no_plugin_no_optimisations_PolyString(), program_names[program_pos]);
+        init_runtime = eval_cache->get_runtime(curr_env, true);
 
         // reset applied_optimisations to all zeros
         for(auto it = applied_optimisations.begin(); it != applied_optimisations.end(); ++it)
             *it = 0;
     }
 
-    /* on completion save weights */
-    save_weights(Q, (std::string)DEFAULT_WEIGHT_SAVE_LOCATION);
-    std::cout << "Training complete, weights saved to location: " << DEFAULT_WEIGHT_SAVE_LOCATION << '\n' << std::flush;
+    /* on completion checkpoint weights and export them as text */
+    save_checkpoint_async((std::string)DEFAULT_CHECKPOINT_LOCATION);
+    save_weights_to_file((std::string)DEFAULT_WEIGHT_SAVE_LOCATION);
+    checkpoint_writer->flush();
+    buff->sync();
+
+    if(metrics != NULL)
+        metrics->flush();
+
+    std::cout << "Training complete, weights saved to location: " << DEFAULT_CHECKPOINT_LOCATION << " (text export: " << DEFAULT_WEIGHT_SAVE_LOCATION << ")\n" << std::flush;
+
+    eval_cache->print_stats();
+    feature_cache->print_stats();
 
     print_agent_information();
 
@@ -153,7 +239,8 @@ void Agent::sampling(const double epsilon, bool terminate)
     std::vector<double> curr_st;
     std::vector<double> next_st;
 
-    curr_st = vec_min_max_scaling(get_program_state(curr_env, get_num_features()));
+    // the next state of the previous step, so normally answered by the feature cache
+    curr_st = vec_min_max_scaling(feature_cache->get_program_state(curr_env, get_num_features()));
 
     int action_pos = epsilon_greedy_action(curr_st, epsilon);
 
@@ -169,20 +256,232 @@ void Agent::sampling(const double epsilon, bool terminate)
         applied_optimisations[action_pos] = 1;
     }
 
-    // get the next state after executing (applying) optimisation
-    next_st = vec_min_max_scaling(get_program_state(curr_env, get_num_features()));
+    // get the next state after executing (applying) optimisation, only compiled for if the flag set has not been seen
+    next_st = vec_min_max_scaling(feature_cache->get_program_state(curr_env, get_num_features()));
 
     // intermediate reward is zero if not episode termination else reward is proportional to the new program runtime compared
     // against the intitial runtime
     if(terminate)
     {
-        double updt_runtime = run_given_string(curr_env->get_no_plugin_PolyString(), curr_env->program_name);
-        reward = get_reward(updt_runtime);
-        std::cout << "Initial Runtime:" << init_runtime << "\t New Runtime: " << updt_runtime << "\t Episode reward: " << reward << '\n';
+        double updt_runtime = eval_cache->get_runtime(curr_env, false);
+        reward = episode_reward(init_runtime, updt_runtime);
     }
 
     // save to replay buffer
-    buff[(curr_buff_pos++) % buffer_size] = new BufferItem(curr_st, action_pos, reward, next_st, terminate);
+    buff->add(curr_st, action_pos, reward, next_st, terminate);
+
+    return;
+}
+
+
+double Agent::episode_reward(const double episode_init_runtime, const double updt_runtime)
+{
+    double reward = DEFAULT_REWARD_FUNCTION(updt_runtime, episode_init_runtime);
+    std::cout << "Initial Runtime:" << episode_init_runtime << "\t New Runtime: " << updt_runtime << "\t Episode reward: " << reward << '\n';
+
+    if(metrics != NULL)
+    {
+        metrics->record(init_runtime_metric, train_step, episode_init_runtime);
+        metrics->record(runtime_metric, train_step, updt_runtime);
+        metrics->record(reward_metric, train_step, reward);
+    }
+
+    return reward;
+}
+
+
+void Agent::train_optimiser_parallel(const double epsilon, const unsigned int num_envs)
+{
+    if(num_envs <= 1)
+    {
+        train_optimiser(epsilon);
+        return;
+    }
+
+    int i, j, k;
+    bool terminate;
+    int curr_itr = 0;
+    int num_features = get_num_features();
+
+    planned_train_steps = train_step + (number_of_episodes * episode_length);
+
+    EnvironmentPool* pool = new EnvironmentPool(num_envs, program_names[0], optimisation_baseline);
+
+    // per environment episode state, environment k is running episode i + k
+    std::vector<std::vector<int>> env_applied(num_envs, std::vector<int>(actions.size()));
+    std::vector<std::vector<double>> curr_states;
+    std::vector<std::vector<double>> next_states;
+    std::vector<double> init_runtimes;
+    std::vector<double> updt_runtimes;
+    std::vector<int> action_pos(num_envs);
+    std::vector<double> rewards(num_envs);
+
+    for(i = 0; i < number_of_episodes; i += num_envs)
+    {
+        int active = std::min((int)num_envs, (int)(number_of_episodes - i));
+
+        // as in train_optimiser the first episode is on the first program and later ones on uniformally chosen programs
+        for(k = 0; k < active; k++)
+        {
+            if((i + k) > 0)
+                pool->get_env(k)->reset_PolyString_environment(program_names[environment_rnd->random_int_range(0, program_names.size()-1)]);
+            else
+                pool->get_env(k)->reset_PolyString_environment(program_names[0]);
+
+            std::fill(env_applied[k].begin(), env_applied[k].end(), 0);
+
+            std::cout << "Episode: " << (i + k) << "\t Program: " << pool->get_env(k)->program_name << "\t Environment: " << k << "\t Training Progress: " << ((i + k + 1) / (double)number_of_episodes) * 100 << "%\n";
+        }
+
+        pool->get_runtimes(active, true, init_runtimes, eval_cache);
+        pool->get_states(active, num_features, curr_states, feature_cache);
+
+        for(j = 0; j < episode_length; j++)
+        {
+            terminate = (((j+1) == episode_length) ? true : false);
+
+            /* sampling - one forward pass chooses every environment's action */
+            epsilon_greedy_actions(curr_states, epsilon, action_pos);
+
+            for(k = 0; k < active; k++)
+            {
+                // negatively reward if optimisation has already been applied and don't apply to the environment string
+                if(env_applied[k][action_pos[k]] == 1)
+                {
+                    rewards[k] = -1;
+                }
+                else
+                {
+                    pool->get_env(k)->optimisations.push_back(actions[action_pos[k]]);
+                    env_applied[k][action_pos[k]] = 1;
+                    rewards[k] = 0;
+                }
+            }
+
+            // the environments compile and run concurrently
+            pool->get_states(active, num_features, next_states, feature_cache);
+
+            if(terminate)
+                pool->get_runtimes(active, false, updt_runtimes, eval_cache);
+
+            /* one transition and training step per environment, in environment order so runs are reproducible */
+            for(k = 0; k < active; k++)
+            {
+                if(terminate)
+                    rewards[k] = episode_reward(init_runtimes[k], updt_runtimes[k]);
+
+                buff->add(curr_states[k], action_pos[k], rewards[k], next_states[k], terminate);
+
+                train_phase();
+
+                if(!(curr_itr % copy_period))
+                    copy_network_weights();
+
+                if(!(curr_itr % ((int)DEFAULT_SAVE_PERIOD)))
+                    save_checkpoint_async((std::string)DEFAULT_CHECKPOINT_LOCATION);
+
+                curr_itr++;
+            }
+
+            // nothing changes an environment between steps so its next state is the following step's current state
+            curr_states.swap(next_states);
+        }
+
+        /* on episode completion */
+        for(k = 0; k < active; k++)
+        {
+            std::cout << "Optimisations applied in episode " << (i + k) << ": ";
+            for(auto const& opt : pool->get_env(k)->optimisations)
+                std::cout << opt << " ";
+            std::cout << "\n";
+        }
+        std::cout << "\n";
+    }
+
+    delete pool;
+
+    /* on completion checkpoint weights and export them as text */
+    save_checkpoint_async((std::string)DEFAULT_CHECKPOINT_LOCATION);
+    save_weights_to_file((std::string)DEFAULT_WEIGHT_SAVE_LOCATION);
+    checkpoint_writer->flush();
+    buff->sync();
+
+    if(metrics != NULL)
+        metrics->flush();
+
+    std::cout << "Training complete, weights saved to location: " << DEFAULT_CHECKPOINT_LOCATION << " (text export: " << DEFAULT_WEIGHT_SAVE_LOCATION << ")\n" << std::flush;
+
+    eval_cache->print_stats();
+    feature_cache->print_stats();
+
+    print_agent_information();
+
+    return;
+}
+
+
+void Agent::train_offline(const std::string& dataset_filename, const unsigned int num_updates)
+{
+    replay_file_header_t header;
+    if(!ReplayBuffer::read_header(dataset_filename, header))
+        return;
+
+    if(header.num_features != get_num_features())
+    {
+        std::cerr << "Dataset " << dataset_filename << " has " << header.num_features << " features, network expects " << get_num_features() << ", no offline training!\n";
+        return;
+    }
+
+    ReplayBuffer* dataset = new ReplayBuffer(dataset_filename, header.capacity, header.num_features, ReplayBuffer::hash_action_space(actions), (replay_state_format_t)header.state_format, replay_sampling);
+
+    if(!dataset->is_file_backed() || dataset->empty())
+    {
+        std::cerr << "Dataset " << dataset_filename << " was not recorded with this action space or is empty, no offline training!\n";
+        delete dataset;
+        return;
+    }
+
+    // minibatches come from the dataset in place of the online buffer
+    ReplayBuffer* online_buff = buff;
+    buff = dataset;
+
+    planned_train_steps = train_step + num_updates;
+
+    std::cout << "Offline training for " << num_updates << " updates on " << buff->size() << " transitions from " << dataset_filename << "\n";
+    report_q_value_stats();
+
+    auto start = std::chrono::steady_clock::now();
+
+    unsigned int i;
+    for(i = 0; i < num_updates; i++)
+    {
+        train_phase();
+
+        /* copy network weights */
+        if(!(i % copy_period))
+            copy_network_weights();
+
+        if(!((i + 1) % DEFAULT_OFFLINE_REPORT_PERIOD))
+            report_q_value_stats();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if(num_updates % DEFAULT_OFFLINE_REPORT_PERIOD)
+        report_q_value_stats();
+
+    buff = online_buff;
+    delete dataset;
+
+    /* on completion checkpoint weights and export them as text */
+    save_checkpoint_async((std::string)DEFAULT_CHECKPOINT_LOCATION);
+    save_weights_to_file((std::string)DEFAULT_WEIGHT_SAVE_LOCATION);
+    checkpoint_writer->flush();
+
+    if(metrics != NULL)
+        metrics->flush();
+
+    std::cout << "Offline training complete, " << (num_updates / elapsed.count()) << " updates/s, weights saved to location: " << DEFAULT_CHECKPOINT_LOCATION << " (text export: " << DEFAULT_WEIGHT_SAVE_LOCATION << ")\n" << std::flush;
 
     return;
 }
@@ -190,42 +489,194 @@ void Agent::sampling(const double epsilon, bool terminate)
 
 void Agent::train_phase()
 {
-    /* uniformly sample the replay buffer */
-    int max_size = (buff[(curr_buff_pos) % buffer_size] == NULL) ? curr_buff_pos : buffer_size;
-    BufferItem* b = buff[rnd->random_int_range(0, max_size - 1)];
+    switch(precision)
+    {
+        case AGENT_PRECISION_DOUBLE:
+            train_networks(Q, Q_hat);
+            break;
+        case AGENT_PRECISION_FLOAT:
+            train_networks(Q_f, Q_hat_f);
+            break;
+        case AGENT_PRECISION_MIXED:
+            train_networks(Q_f, Q_hat);
+            break;
+    }
+
+    train_step++;
+
+    return;
+}
 
 
-    double y_j;
-    if(b->get_terminate())
+template<typename QNet, typename TargetNet>
+void Agent::train_networks(QNet* q, TargetNet* q_hat)
+{
+    int i;
+    int num_features = get_num_features();
+
+    typename QNet::matrix_t curr_states(batch_size, num_features);
+    typename TargetNet::matrix_t next_states(batch_size, num_features);
+    std::vector<int> action_positions(batch_size);
+    std::vector<double> rewards(batch_size);
+    std::vector<unsigned char> terminates(batch_size);
+    std::vector<int> sample_pos(batch_size);
+    std::vector<double> is_weights(batch_size);
+
+    // importance sampling correction is annealed from DEFAULT_PRIORITY_BETA to 1 over training
+    double progress = std::min(1.0, train_step / (double)planned_train_steps);
+    double beta = DEFAULT_PRIORITY_BETA + ((1.0 - DEFAULT_PRIORITY_BETA) * progress);
+
+    /* sample a minibatch from the replay buffer */
+    buff->sample(sampling_rnd, sample_pos, is_weights, beta);
+    buff->gather(sample_pos, curr_states, next_states, action_positions.data(), rewards.data(), terminates.data());
+
+    // find the best action values for every next state with Q_hat
+    const typename TargetNet::matrix_t& out_hat = q_hat->forward_propogate(next_states);
+
+    // setting yj for each sample, computed in the precision of Q_hat - only the taken action carries a target
+    std::vector<double> y(batch_size);
+    for(i = 0; i < batch_size; i++)
     {
-        y_j = b->get_reward();
+        y[i] = rewards[i];
+
+        if(!terminates[i])
+            y[i] += (discount_rate * out_hat.row(i).maxCoeff());
+    }
+
+    // forward proporgate to save network output in Q object
+    const typename QNet::matrix_t& out_Q = q->forward_propogate(curr_states);
+
+    if(metrics != NULL)
+    {
+        // mean loss over the minibatch
+        Eigen::MatrixXd yj_row = Eigen::MatrixXd::Zero(1, actions.size());
+
+        double loss = 0;
+        for(i = 0; i < batch_size; i++)
+        {
+            yj_row(0, action_positions[i]) = y[i];
+            loss += (q->loss_function(yj_row, out_Q.row(i).template cast<double>(), action_positions[i]))(0, action_positions[i]);
+            yj_row(0, action_positions[i]) = 0;
+        }
+
+        metrics->record(loss_metric, train_step, loss / batch_size);
+    }
+
+    // gradient descent step, only the output of the taken action has a gradient
+    if(replay_sampling == REPLAY_SAMPLING_PRIORITISED)
+    {
+        // reprioritise by the td error, and weight each sample's gradient to correct for the non uniform sampling
+        std::vector<double> td_errors(batch_size);
+        for(i = 0; i < batch_size; i++)
+            td_errors[i] = y[i] - out_Q(i, action_positions[i]);
+
+        buff->update_priorities(sample_pos, td_errors);
+
+        q->back_propogate_rl_sparse(y, action_positions, is_weights);
     }
     else
     {
-        // find the best action value with Q_hat
-        Eigen::MatrixXd out = Q_hat->forward_propogate(b->get_next_st());
+        q->back_propogate_rl_sparse(y, action_positions);
+    }
+
+    q->update_weights();
+
+    return;
+}
+
 
-        int best_pos = Agent::best_q_action(out, actions.size());
+/* Q-VALUE STATISTICS */
 
-        y_j = b->get_reward() + (discount_rate * out(0, best_pos));
+
+q_value_stats_t Agent::q_value_stats()
+{
+    switch(precision)
+    {
+        case AGENT_PRECISION_FLOAT:
+            return compute_q_value_stats(Q_f, Q_hat_f);
+        case AGENT_PRECISION_MIXED:
+            return compute_q_value_stats(Q_f, Q_hat);
+        default:
+            return compute_q_value_stats(Q, Q_hat);
     }
+}
 
-    // forward proporgate to save network output in Q object
-    Eigen::MatrixXd out_Q = Q->forward_propogate(b->get_curr_st());
 
-    // setting yj
-    Eigen::MatrixXd out_yj = Eigen::MatrixXd::Zero(out_Q.rows(), out_Q.cols());
-    out_yj(0, b->get_action_pos()) = y_j;
+template<typename QNet, typename TargetNet>
+q_value_stats_t Agent::compute_q_value_stats(QNet* q, TargetNet* q_hat)
+{
+    int n = buff->size();
+    int num_features = get_num_features();
+
+    q_value_stats_t stats = {(unsigned int)n, 0.0, 0.0, std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), 0.0};
 
-    if(gradient_monitoring)
+    if(n == 0)
+        return stats;
+
+    typename QNet::matrix_t curr_states;
+    typename TargetNet::matrix_t next_states;
+    std::vector<int> positions;
+    std::vector<int> action_positions;
+    std::vector<double> rewards;
+    std::vector<unsigned char> terminates;
+
+    // the whole buffer in chunks of DEFAULT_Q_STATS_BATCH transitions
+    int start, i;
+    for(start = 0; start < n; start += DEFAULT_Q_STATS_BATCH)
     {
-        grad_monitor_file << std::to_string((Q->loss_function(out_yj, out_Q, b->get_action_pos()))(0, b->get_action_pos())) << '\n';
-        grad_monitor_file.flush();
+        int rows = std::min(DEFAULT_Q_STATS_BATCH, n - start);
+
+        positions.resize(rows);
+        for(i = 0; i < rows; i++)
+            positions[i] = start + i;
+
+        curr_states.resize(rows, num_features);
+        next_states.resize(rows, num_features);
+        action_positions.resize(rows);
+        rewards.resize(rows);
+        terminates.resize(rows);
+
+        buff->gather(positions, curr_states, next_states, action_positions.data(), rewards.data(), terminates.data());
+
+        const typename TargetNet::matrix_t& out_hat = q_hat->forward_propogate(next_states);
+        const typename QNet::matrix_t& out_Q = q->forward_propogate(curr_states);
+
+        for(i = 0; i < rows; i++)
+        {
+            double action_q = out_Q(i, action_positions[i]);
+
+            double y = rewards[i];
+            if(!terminates[i])
+                y += (discount_rate * out_hat.row(i).maxCoeff());
+
+            stats.mean_max_q += out_Q.row(i).maxCoeff();
+            stats.mean_action_q += action_q;
+            stats.min_q = std::min(stats.min_q, (double)out_Q.row(i).minCoeff());
+            stats.max_q = std::max(stats.max_q, (double)out_Q.row(i).maxCoeff());
+            stats.mean_abs_td_error += std::abs(y - action_q);
+        }
     }
 
-    // gradient descent step
-    Q->back_propogate_rl(out_yj, b->get_action_pos());
-    Q->update_weights();
+    stats.mean_max_q /= n;
+    stats.mean_action_q /= n;
+    stats.mean_abs_td_error /= n;
+
+    return stats;
+}
+
+
+void Agent::report_q_value_stats()
+{
+    q_value_stats_t stats = q_value_stats();
+
+    std::cout << "Update: " << train_step << "\t Mean max Q: " << stats.mean_max_q << "\t Mean action Q: " << stats.mean_action_q << "\t Q range: [" << stats.min_q << ", " << stats.max_q << "]\t Mean |TD error|: " << stats.mean_abs_td_error << '\n';
+
+    if(metrics != NULL)
+    {
+        metrics->record(mean_max_q_metric, train_step, stats.mean_max_q);
+        metrics->record(mean_action_q_metric, train_step, stats.mean_action_q);
+        metrics->record(td_error_metric, train_step, stats.mean_abs_td_error);
+    }
 
     return;
 }
@@ -236,14 +687,81 @@ void Agent::train_phase()
 
 int Agent::epsilon_greedy_action(const std::vector<double>& st, const double epsilon)
 {
-    double r = rnd->random_double_range(0.0, 1.0);
+    double r = exploration_rnd->random_double_range(0.0, 1.0);
 
     if(r > (1 - epsilon))
     {
-        return rnd->random_int_range(0, actions.size()-1);
+        return exploration_rnd->random_int_range(0, actions.size()-1);
     }
 
-    Eigen::MatrixXd q_vals = Q->forward_propogate(st);
+    if(Q != NULL)
+        return greedy_action(Q, st);
+
+    return greedy_action(Q_f, st);
+}
+
+
+void Agent::epsilon_greedy_actions(const std::vector<std::vector<double>>& states, const double epsilon, std::vector<int>& action_pos)
+{
+    int i;
+    int n = states.size();
+    action_pos.resize(n);
+
+    // exploration is drawn for every state in order, exploiting states are then answered by one forward pass
+    std::vector<int> greedy;
+    for(i = 0; i < n; i++)
+    {
+        double r = exploration_rnd->random_double_range(0.0, 1.0);
+
+        if(r > (1 - epsilon))
+        {
+            action_pos[i] = exploration_rnd->random_int_range(0, actions.size()-1);
+        }
+        else
+        {
+            action_pos[i] = -1;
+            greedy.push_back(i);
+        }
+    }
+
+    if(greedy.empty())
+        return;
+
+    if(Q != NULL)
+        greedy_actions(Q, states, greedy, action_pos);
+    else
+        greedy_actions(Q_f, states, greedy, action_pos);
+
+    return;
+}
+
+
+template<typename QNet>
+void Agent::greedy_actions(QNet* q, const std::vector<std::vector<double>>& states, const std::vector<int>& rows, std::vector<int>& action_pos)
+{
+    int i;
+    int num_features = get_num_features();
+
+    typename QNet::matrix_t batch(rows.size(), num_features);
+    for(i = 0; i < (int)rows.size(); i++)
+        batch.row(i) = Eigen::Map<const Eigen::RowVectorXd>(states[rows[i]].data(), num_features).template cast<typename QNet::scalar_t>();
+
+    typename QNet::inference_scratch_t scratch;
+    Eigen::MatrixXd q_vals = q->infer(batch, scratch).template cast<double>();
+
+    for(i = 0; i < (int)rows.size(); i++)
+        action_pos[rows[i]] = Agent::best_q_action(q_vals.row(i), actions.size());
+
+    return;
+}
+
+
+template<typename QNet>
+int Agent::greedy_action(QNet* q, const std::vector<double>& st)
+{
+    // action selection never back propogates so skip the derivatives
+    typename QNet::inference_scratch_t scratch;
+    Eigen::MatrixXd q_vals = q->infer(st, scratch).template cast<double>();
 
     int best_pos = Agent::best_q_action(q_vals, actions.size());
 
@@ -254,11 +772,28 @@ int Agent::epsilon_greedy_action(const std::vector<double>& st, const double eps
 void Agent::copy_network_weights()
 {
     // set Q_hat to Q (weights)
+    switch(precision)
+    {
+        case AGENT_PRECISION_DOUBLE:
+            copy_weights(Q, Q_hat);
+            break;
+        case AGENT_PRECISION_FLOAT:
+            copy_weights(Q_f, Q_hat_f);
+            break;
+        case AGENT_PRECISION_MIXED:
+            copy_weights(Q_f, Q_hat);
+            break;
+    }
 
-    // for each layer copy the weights matrix (excluding last)
-    int i;
-    for(i = 0; i < ((Q->num_layers)-1); i++)
-        Q_hat->layers[i]->W = Q->layers[i]->W; // this may be weird
+    return;
+}
+
+
+template<typename FromNet, typename ToNet>
+void Agent::copy_weights(const FromNet* from, ToNet* to)
+{
+    // one copy of the whole weight slab
+    to->copy_weights_from(from);
 
     return;
 }
@@ -266,13 +801,41 @@ void Agent::copy_network_weights()
 
 void Agent::load_weights_from_file(const std::string& filename)
 {
-    load_weights(Q, filename);
+    bool binary = is_checkpoint_file(filename);
+
+    if(Q != NULL)
+        (binary) ? (void)load_checkpoint(Q, filename) : load_weights(Q, filename);
+    else
+        (binary) ? (void)load_checkpoint(Q_f, filename) : load_weights(Q_f, filename);
+
     copy_network_weights();
 
     return;
 }
 
 
+void Agent::save_weights_to_file(const std::string& filename)
+{
+    if(Q != NULL)
+        save_weights(Q, filename);
+    else
+        save_weights(Q_f, filename);
+
+    return;
+}
+
+
+void Agent::save_checkpoint_async(const std::string& filename)
+{
+    if(Q != NULL)
+        checkpoint_writer->save(Q, filename);
+    else
+        checkpoint_writer->save(Q_f, filename);
+
+    return;
+}
+
+
 double Agent::get_reward(const double new_runtime)
 {
     return DEFAULT_REWARD_FUNCTION(new_runtime, init_runtime);
@@ -281,17 +844,26 @@ double Agent::get_reward(const double new_runtime)
 
 void Agent::print_networks()
 {
+    auto print_layers = [](const auto* net)
+    {
+        for(auto l : net->layers)
+            std::cout << l->W << "\n\n";
+        std::cout << std::endl;
+    };
+
     std::cout << "Q network:\n";
 
-    for(auto l : Q->layers)
-        std::cout << l->W << "\n\n";
-    std::cout << std::endl;
+    if(Q != NULL)
+        print_layers(Q);
+    else
+        print_layers(Q_f);
 
     std::cout << "Q_hat network:\n";
 
-    for(auto l : Q_hat->layers)
-        std::cout << l->W << "\n\n";
-    std::cout << std::endl;
+    if(Q_hat != NULL)
+        print_layers(Q_hat);
+    else
+        print_layers(Q_hat_f);
 
     return;
 }
@@ -305,6 +877,15 @@ void Agent::print_agent_information()
     std::cout << "Episode length: " << episode_length << '\n';
     std::cout << "Discount rate: " << discount_rate << '\n';
     std::cout << "Buffer size: " << buffer_size << '\n';
+    std::cout << "Batch size: " << batch_size << '\n';
+    std::cout << "Optimiser: " << optimiser_to_string(optimiser) << '\n';
+    std::cout << "Training threads: " << ((num_threads > 0) ? num_threads : 1) << '\n';
+    std::cout << "Replay sampling: " << ((replay_sampling == REPLAY_SAMPLING_PRIORITISED) ? "prioritised" : "uniform") << '\n';
+    std::cout << "Replay store: " << (replay_filename.empty() ? "none" : replay_filename) << '\n';
+    std::cout << "Replay state format: " << replay_state_format_to_string(replay_state_format) << '\n';
+    std::cout << "Evaluation cache: " << (eval_cache_filename.empty() ? "memory" : eval_cache_filename) << '\n';
+    std::cout << "Feature cache: " << (feature_cache_filename.empty() ? "memory" : feature_cache_filename) << '\n';
+    std::cout << "Precision: " << ((precision == AGENT_PRECISION_DOUBLE) ? "double" : ((precision == AGENT_PRECISION_FLOAT) ? "float" : "mixed")) << '\n';
     std::cout << "\n=================\n" << "TRAINING INFORMATION\n" << "=================\n";
     std::cout << "Action space: " << opt_vec_to_string(actions) << '\n';
     std::cout << "\nProgram training space: " << opt_vec_to_string(program_names) << '\n';
@@ -330,6 +911,15 @@ void Agent::save_agent_information()
     out_file << "Episode length: " << episode_length << '\n';
     out_file << "Discount rate: " << discount_rate << '\n';
     out_file << "Buffer size: " << buffer_size << '\n';
+    out_file << "Batch size: " << batch_size << '\n';
+    out_file << "Optimiser: " << optimiser_to_string(optimiser) << '\n';
+    out_file << "Training threads: " << ((num_threads > 0) ? num_threads : 1) << '\n';
+    out_file << "Replay sampling: " << ((replay_sampling == REPLAY_SAMPLING_PRIORITISED) ? "prioritised" : "uniform") << '\n';
+    out_file << "Replay store: " << (replay_filename.empty() ? "none" : replay_filename) << '\n';
+    out_file << "Replay state format: " << replay_state_format_to_string(replay_state_format) << '\n';
+    out_file << "Evaluation cache: " << (eval_cache_filename.empty() ? "memory" : eval_cache_filename) << '\n';
+    out_file << "Feature cache: " << (feature_cache_filename.empty() ? "memory" : feature_cache_filename) << '\n';
+    out_file << "Precision: " << ((precision == AGENT_PRECISION_DOUBLE) ? "double" : ((precision == AGENT_PRECISION_FLOAT) ? "float" : "mixed")) << '\n';
     out_file << "\n=================\n" << "TRAINING INFORMATION\n" << "=================\n";
     out_file << "Action space: " << opt_vec_to_string(actions) << '\n';
     out_file << "\nProgram training space: " << opt_vec_to_string(program_names) << '\n';
@@ -344,43 +934,34 @@ void Agent::save_agent_information()
 /* STATIC TRAINED POLICY FUNCTIONS */
 
 
-std::vector<std::string> Agent::select_actions_via_policy(MLP* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, int num_actions)
+std::vector<std::string> Agent::select_actions_via_policy(const MLP* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, int num_actions, FeatureCache* feature_cache)
 {
-    std::vector<int> selected(action_space.size());
-    std::vector<double> curr_st;
-
-    // generate agent's environment
-    PolyString* my_env = construct_polybench_PolyString(program_name, optimisation_baseline);
-
-    int i;
-    for(i = 0; i < num_actions; i++)
-    {
-        // forward prop the curr_env to get q_vals
-        curr_st = vec_min_max_scaling(get_program_state(my_env, Q_net->layers[0]->W.rows()));
+    return policy_rollout(Q_net, Q_net->layers[0]->W.rows(), program_name, action_space, optimisation_baseline, num_actions, feature_cache);
+}
 
-        Eigen::MatrixXd vals = Q_net->forward_propogate(curr_st);
 
-        int best_pos = best_q_action(vals, vals.cols());
+std::vector<std::string> Agent::select_actions_via_policy(const MLP* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, FeatureCache* feature_cache)
+{
+    return select_actions_via_policy(Q_net, program_name, action_space, optimisation_baseline, action_space.size(), feature_cache);
+}
 
-        // append to ret vector only if not already selected
-        if(selected[best_pos] != 1)
-        {
-            selected[best_pos] = 1;
-            my_env->optimisations.push_back(action_space[best_pos]);
-        }
-    }
 
-    std::vector<std::string> ret(my_env->optimisations);
-    return ret;
+std::vector<std::string> Agent::select_actions_via_policy(const QuantizedMLP* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, int num_actions, FeatureCache* feature_cache)
+{
+    return policy_rollout(Q_net, Q_net->get_num_features(), program_name, action_space, optimisation_baseline, num_actions, feature_cache);
 }
 
 
-std::vector<std::string> Agent::select_actions_via_policy(MLP* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline)
+std::vector<std::string> Agent::select_actions_via_policy(const QuantizedMLP* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, FeatureCache* feature_cache)
 {
-    return select_actions_via_policy(Q_net, program_name, action_space, optimisation_baseline, action_space.size());
+    return select_actions_via_policy(Q_net, program_name, action_space, optimisation_baseline, action_space.size(), feature_cache);
 }
 
 
+// StaticMLP rollout for the default network, built with Agent so its checks against the DEFAULT_* network always run
+template std::vector<std::string> Agent::select_actions_via_policy<7, 30, 30, 30, 11>(const StaticMLP<7, 30, 30, 30, 11>* Q_net, const std::string& program_name, const std::vector<std::string>& action_space, const std::string& optimisation_baseline, int num_actions, FeatureCache* feature_cache);
+
+
 /* STATIC HELPER FUNCTIONS */
 
 
@@ -1,14 +0,0 @@
-/***
- * AUTHOR: Harry Findlay
- * LICENSE: Shipped with package - GNU GPL v3.0
- * FILE START: 25/04/2024
- * FILE LAST UPDATED: 26/04/2024
- * 
- * REQUIREMENTS: Eigen v3.4.0, src: https://eigen.tuxfamily.org/index.php?title=Main_Page
-
- * 
- * DESCRIPTION: Class implementation for BufferItem that makes up each item in the replay buffer for DQL.
-*/
-
-#include "dqn/BufferItem.h"
-
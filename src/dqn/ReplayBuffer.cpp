@@ -0,0 +1,642 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 25/04/2024
+ * FILE LAST UPDATED: 09/05/2024
+ *
+ * REQUIREMENTS: Eigen v3.4.0, src: https://eigen.tuxfamily.org/index.php?title=Main_Page
+ * REFERENCES: Tom Schaul et al. "Prioritized experience replay."
+ *
+ * DESCRIPTION: Class implementation for the fixed capacity experience replay buffer for DQL.
+*/
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dqn/ReplayBuffer.h"
+
+
+/* SUM TREE */
+
+
+SumTree::SumTree(const unsigned int capacity)
+{
+    num_leaves = 1;
+    while(num_leaves < capacity)
+        num_leaves <<= 1;
+
+    sums.assign(2 * num_leaves, 0.0);
+    mins.assign(2 * num_leaves, std::numeric_limits<double>::infinity());
+
+    return;
+}
+
+
+void SumTree::set(const int leaf, const double priority)
+{
+    int node = num_leaves + leaf;
+
+    sums[node] = priority;
+    mins[node] = priority;
+
+    // parents are recomputed from their children rather than adjusted by the change, so sums never drift
+    for(node /= 2; node > 0; node /= 2)
+    {
+        sums[node] = sums[2*node] + sums[2*node + 1];
+        mins[node] = std::min(mins[2*node], mins[2*node + 1]);
+    }
+
+    return;
+}
+
+
+int SumTree::find(double u) const
+{
+    int node = 1;
+
+    while(node < num_leaves)
+    {
+        int left = 2 * node;
+
+        // rounding can push u past the last non zero leaf, never step into an empty subtree
+        if((u < sums[left]) || (sums[left + 1] <= 0.0))
+        {
+            node = left;
+        }
+        else
+        {
+            u -= sums[left];
+            node = left + 1;
+        }
+    }
+
+    return node - num_leaves;
+}
+
+
+/* HELPERS */
+
+
+static std::size_t align_up(std::size_t n)
+{
+    return (n + REPLAY_ALIGNMENT - 1) & ~((std::size_t)REPLAY_ALIGNMENT - 1);
+}
+
+
+static uint64_t fnv1a_64(const unsigned char* data, std::size_t n, uint64_t hash = 14695981039346656037ULL)
+{
+    std::size_t i;
+    for(i = 0; i < n; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+
+static std::size_t state_row_size(const replay_state_format_t format, const int num_features)
+{
+    switch(format)
+    {
+        case REPLAY_STATE_FLOAT16:
+            return num_features * sizeof(Eigen::half);
+        case REPLAY_STATE_UINT8:
+            return (2 * sizeof(float)) + num_features;
+        default:
+            return num_features * sizeof(double);
+    }
+}
+
+
+/**
+ * @brief Byte offset of each array of a replay store, see the format in ReplayBuffer.h.
+ */
+struct replay_layout_t
+{
+    std::size_t states;
+    std::size_t curr_state_idx;
+    std::size_t next_state_idx;
+    std::size_t rewards;
+    std::size_t action_positions;
+    std::size_t terminates;
+    std::size_t size;
+};
+
+
+static replay_layout_t replay_layout(const unsigned int capacity, const int num_features, const replay_state_format_t format)
+{
+    // every transition refers to at most two states
+    std::size_t max_states = 2 * (std::size_t)capacity;
+
+    replay_layout_t layout;
+    layout.states = align_up(sizeof(replay_file_header_t));
+    layout.curr_state_idx = layout.states + align_up(max_states * state_row_size(format, num_features));
+    layout.next_state_idx = layout.curr_state_idx + align_up(capacity * sizeof(uint32_t));
+    layout.rewards = layout.next_state_idx + align_up(capacity * sizeof(uint32_t));
+    layout.action_positions = layout.rewards + align_up(capacity * sizeof(double));
+    layout.terminates = layout.action_positions + align_up(capacity * sizeof(int32_t));
+    layout.size = layout.terminates + align_up(capacity);
+
+    return layout;
+}
+
+
+static void init_header(replay_file_header_t* header, const unsigned int capacity, const int num_features, const replay_state_format_t format, const uint64_t action_space_hash)
+{
+    std::memset(header, 0, sizeof(replay_file_header_t));
+    std::memcpy(header->magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+
+    header->version = REPLAY_VERSION;
+    header->num_features = num_features;
+    header->capacity = capacity;
+    header->state_format = format;
+    header->action_space_hash = action_space_hash;
+    header->num_added = 0;
+}
+
+
+/* REPLAY BUFFER */
+
+
+ReplayBuffer::ReplayBuffer(const unsigned int capacity, const int num_features, const replay_state_format_t state_format, const replay_sampling_t sampling, const double alpha)
+:
+    capacity(capacity),
+    num_features(num_features),
+    storage(NULL),
+    state_format(state_format),
+    sampling(sampling),
+    priorities(NULL),
+    alpha(alpha),
+    max_priority(1.0)
+{
+    if(capacity == 0)
+    {
+        std::cerr << "Replay buffer capacity must be at least one, exiting!\n";
+        std::exit(-1);
+    }
+
+    allocate(0);
+    init_states();
+    init_priorities();
+
+    return;
+}
+
+
+ReplayBuffer::ReplayBuffer(const std::string& filename, const unsigned int capacity, const int num_features, const uint64_t action_space_hash, const replay_state_format_t state_format, const replay_sampling_t sampling, const double alpha)
+:
+    capacity(capacity),
+    num_features(num_features),
+    storage(NULL),
+    filename(filename),
+    state_format(state_format),
+    sampling(sampling),
+    priorities(NULL),
+    alpha(alpha),
+    max_priority(1.0)
+{
+    if(capacity == 0)
+    {
+        std::cerr << "Replay buffer capacity must be at least one, exiting!\n";
+        std::exit(-1);
+    }
+
+    if(!map_file(action_space_hash))
+    {
+        std::cerr << "Replay buffer will not be saved to " << filename << '\n';
+
+        this->filename.clear();
+        allocate(action_space_hash);
+    }
+
+    init_states();
+    init_priorities();
+
+    return;
+}
+
+
+ReplayBuffer::~ReplayBuffer()
+{
+    munmap(storage, storage_size);
+
+    delete priorities;
+}
+
+
+bool ReplayBuffer::map_file(const uint64_t action_space_hash)
+{
+    storage_size = replay_layout(capacity, num_features, state_format).size;
+
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+    {
+        std::cerr << "ERROR OPENING REPLAY STORE: " << filename << '\n';
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        std::cerr << "ERROR OPENING REPLAY STORE: " << filename << '\n';
+        close(fd);
+        return false;
+    }
+
+    bool fresh = (st.st_size == 0);
+
+    if(!fresh)
+    {
+        // an existing store is only reused for the same buffer, anything else is left as it is
+        replay_file_header_t existing;
+        if((st.st_size < (off_t)sizeof(existing)) || (pread(fd, &existing, sizeof(existing), 0) != (ssize_t)sizeof(existing)) || std::memcmp(existing.magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) || (existing.version != REPLAY_VERSION))
+        {
+            std::cerr << "FILE IS NOT A REPLAY STORE OF THIS VERSION: " << filename << '\n';
+            close(fd);
+            return false;
+        }
+
+        if((existing.capacity != capacity) || (existing.num_features != num_features) || (existing.state_format != state_format) || (existing.action_space_hash != action_space_hash) || (st.st_size != (off_t)storage_size))
+        {
+            std::cerr << "REPLAY STORE DOES NOT MATCH BUFFER (capacity " << existing.capacity << " vs " << capacity << ", features " << existing.num_features << " vs " << num_features << ", state format " << existing.state_format << " vs " << state_format << ", action space " << ((existing.action_space_hash == action_space_hash) ? "same" : "different") << "): " << filename << '\n';
+            close(fd);
+            return false;
+        }
+    }
+    else if(ftruncate(fd, storage_size) != 0)
+    {
+        // the file is sparse, state rows only take disk space once written
+        std::cerr << "ERROR SIZING REPLAY STORE: " << filename << '\n';
+        close(fd);
+        return false;
+    }
+
+    void* mapped = mmap(NULL, storage_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(mapped == MAP_FAILED)
+    {
+        std::cerr << "ERROR MAPPING REPLAY STORE: " << filename << '\n';
+        return false;
+    }
+
+    storage = (char*)mapped;
+    header = (replay_file_header_t*)storage;
+
+    if(fresh)
+        init_header(header, capacity, num_features, state_format, action_space_hash);
+
+    attach_arrays();
+
+    return true;
+}
+
+
+void ReplayBuffer::allocate(const uint64_t action_space_hash)
+{
+    storage_size = replay_layout(capacity, num_features, state_format).size;
+
+    // anonymous pages are zero and only backed by memory once touched, as with a file
+    void* mapped = mmap(NULL, storage_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapped == MAP_FAILED)
+    {
+        std::cerr << "Replay buffer allocation failed, exiting!\n";
+        std::exit(-1);
+    }
+
+    storage = (char*)mapped;
+
+    header = (replay_file_header_t*)storage;
+    init_header(header, capacity, num_features, state_format, action_space_hash);
+
+    attach_arrays();
+}
+
+
+void ReplayBuffer::attach_arrays()
+{
+    replay_layout_t layout = replay_layout(capacity, num_features, state_format);
+
+    states = (unsigned char*)(storage + layout.states);
+    curr_state_idx = (uint32_t*)(storage + layout.curr_state_idx);
+    next_state_idx = (uint32_t*)(storage + layout.next_state_idx);
+    rewards = (double*)(storage + layout.rewards);
+    action_positions = (int32_t*)(storage + layout.action_positions);
+    terminates = (unsigned char*)(storage + layout.terminates);
+}
+
+
+void ReplayBuffer::init_states()
+{
+    state_stride = state_row_size(state_format, num_features);
+    max_states = 2 * capacity;
+
+    state_refs.assign(max_states, 0);
+    free_states.reserve(max_states);
+    encoded.resize(state_stride);
+
+    // at most half full so probe sequences stay short
+    std::size_t table_size = 1;
+    while(table_size < (2 * (std::size_t)max_states))
+        table_size <<= 1;
+
+    intern_table.assign(table_size, 0);
+    intern_mask = table_size - 1;
+
+    // rebuild the references of a reopened store from its transitions
+    num_states = 0;
+
+    unsigned int i;
+    for(i = 0; i < size(); i++)
+    {
+        state_refs[curr_state_idx[i]]++;
+        state_refs[next_state_idx[i]]++;
+
+        num_states = std::max(num_states, std::max(curr_state_idx[i], next_state_idx[i]) + 1);
+    }
+
+    for(i = 0; i < num_states; i++)
+    {
+        if(state_refs[i] > 0)
+            insert_interned(i);
+        else
+            free_states.push_back(i);
+    }
+}
+
+
+void ReplayBuffer::init_priorities()
+{
+    if(sampling != REPLAY_SAMPLING_PRIORITISED)
+        return;
+
+    priorities = new SumTree(capacity);
+
+    // transitions from a reopened store have not been seen by this agent
+    unsigned int i;
+    for(i = 0; i < size(); i++)
+        priorities->set(i, max_priority);
+}
+
+
+/* STATE INTERNING */
+
+
+void ReplayBuffer::encode_state(const std::vector<double>& st, unsigned char* out) const
+{
+    int i;
+    switch(state_format)
+    {
+        case REPLAY_STATE_FLOAT16:
+        {
+            Eigen::Map<Eigen::Matrix<Eigen::half, 1, Eigen::Dynamic>>((Eigen::half*)out, num_features) = Eigen::Map<const Eigen::RowVectorXd>(st.data(), num_features).cast<float>().cast<Eigen::half>();
+            break;
+        }
+        case REPLAY_STATE_UINT8:
+        {
+            // affine quantisation over the state's own range
+            auto values = Eigen::Map<const Eigen::RowVectorXd>(st.data(), num_features);
+
+            float offset_scale[2] = {(float)values.minCoeff(), (float)((values.maxCoeff() - values.minCoeff()) / 255.0)};
+            std::memcpy(out, offset_scale, sizeof(offset_scale));
+
+            unsigned char* q = out + sizeof(offset_scale);
+            for(i = 0; i < num_features; i++)
+                q[i] = (offset_scale[1] > 0) ? (unsigned char)std::min(255.0, std::max(0.0, std::round((st[i] - offset_scale[0]) / offset_scale[1]))) : 0;
+
+            break;
+        }
+        default:
+            std::memcpy(out, st.data(), state_stride);
+            break;
+    }
+}
+
+
+void ReplayBuffer::insert_interned(const uint32_t state)
+{
+    std::size_t slot = fnv1a_64(state_row(state), state_stride) & intern_mask;
+
+    while(intern_table[slot] != 0)
+        slot = (slot + 1) & intern_mask;
+
+    intern_table[slot] = state + 1;
+}
+
+
+uint32_t ReplayBuffer::intern_state(const std::vector<double>& st)
+{
+    // identical states compare equal once encoded, so lossy formats also merge states that encode the same
+    encode_state(st, encoded.data());
+
+    std::size_t slot = fnv1a_64(encoded.data(), state_stride) & intern_mask;
+
+    while(intern_table[slot] != 0)
+    {
+        uint32_t state = intern_table[slot] - 1;
+
+        if(!std::memcmp(state_row(state), encoded.data(), state_stride))
+        {
+            state_refs[state]++;
+            return state;
+        }
+
+        slot = (slot + 1) & intern_mask;
+    }
+
+    // new state, reuse a released row before touching a new one
+    uint32_t state;
+    if(!free_states.empty())
+    {
+        state = free_states.back();
+        free_states.pop_back();
+    }
+    else
+    {
+        state = num_states++;
+    }
+
+    std::memcpy(state_row(state), encoded.data(), state_stride);
+    state_refs[state] = 1;
+    intern_table[slot] = state + 1;
+
+    return state;
+}
+
+
+void ReplayBuffer::release_state(const uint32_t state)
+{
+    if(--state_refs[state] > 0)
+        return;
+
+    std::size_t slot = fnv1a_64(state_row(state), state_stride) & intern_mask;
+    while(intern_table[slot] != (state + 1))
+        slot = (slot + 1) & intern_mask;
+
+    // backward shift deletion, entries after the hole move up unless that would put them before their home slot
+    std::size_t next = slot;
+    while(true)
+    {
+        next = (next + 1) & intern_mask;
+
+        if(intern_table[next] == 0)
+            break;
+
+        std::size_t home = fnv1a_64(state_row(intern_table[next] - 1), state_stride) & intern_mask;
+
+        if(((next - home) & intern_mask) >= ((next - slot) & intern_mask))
+        {
+            intern_table[slot] = intern_table[next];
+            slot = next;
+        }
+    }
+
+    intern_table[slot] = 0;
+    free_states.push_back(state);
+}
+
+
+/* MISC */
+
+
+uint64_t ReplayBuffer::hash_action_space(const std::vector<std::string>& actions)
+{
+    uint64_t hash = fnv1a_64(NULL, 0);
+
+    // the terminator is hashed too so e.g. {"ab", "c"} and {"a", "bc"} differ
+    for(auto const& a : actions)
+        hash = fnv1a_64((const unsigned char*)a.c_str(), a.size() + 1, hash);
+
+    return hash;
+}
+
+
+bool ReplayBuffer::read_header(const std::string& filename, replay_file_header_t& header)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        std::cerr << "FILENAME ENTERED IS NOT VALID! CANNOT READ REPLAY STORE: " << filename << '\n';
+        return false;
+    }
+
+    bool valid = (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)) && !std::memcmp(header.magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) && (header.version == REPLAY_VERSION);
+    close(fd);
+
+    if(!valid)
+        std::cerr << "FILE IS NOT A REPLAY STORE OF THIS VERSION: " << filename << '\n';
+
+    return valid;
+}
+
+
+void ReplayBuffer::sync()
+{
+    if(is_file_backed())
+        msync(storage, storage_size, MS_SYNC);
+}
+
+
+/* TRANSITIONS */
+
+
+void ReplayBuffer::add(const std::vector<double>& curr_st, const int action_pos, const double reward, const std::vector<double>& next_st, bool terminate)
+{
+    if((curr_st.size() != num_features) || (next_st.size() != num_features))
+    {
+        std::cerr << "State added to replay buffer is not of correct size, exiting!\n";
+        std::exit(-1);
+    }
+
+    unsigned int pos = header->num_added % capacity;
+
+    // the overwritten transition lets go of its states first, so the table never needs more than two rows per transition
+    if(header->num_added >= capacity)
+    {
+        release_state(curr_state_idx[pos]);
+        release_state(next_state_idx[pos]);
+    }
+
+    curr_state_idx[pos] = intern_state(curr_st);
+    next_state_idx[pos] = intern_state(next_st);
+    action_positions[pos] = action_pos;
+    rewards[pos] = reward;
+    terminates[pos] = terminate;
+
+    if(priorities != NULL)
+        priorities->set(pos, max_priority);
+
+    // only counted once written, see the replay store format
+    header->num_added++;
+
+    return;
+}
+
+
+void ReplayBuffer::sample(rand_helper* rnd, std::vector<int>& positions, std::vector<double>& weights, const double beta) const
+{
+    int n = positions.size();
+    weights.resize(n);
+
+    if(empty())
+    {
+        std::cerr << "Cannot sample from an empty replay buffer, exiting!\n";
+        std::exit(-1);
+    }
+
+    int i;
+    if(priorities == NULL)
+    {
+        rnd->fill_int_range(positions.data(), n, 0, size() - 1);
+
+        for(i = 0; i < n; i++)
+            weights[i] = 1.0;
+
+        return;
+    }
+
+    double total = priorities->total();
+    double segment = total / n;
+
+    // largest weight belongs to the smallest priority, weights are scaled so it is 1
+    double max_weight = std::pow(size() * (priorities->min() / total), -beta);
+
+    for(i = 0; i < n; i++)
+    {
+        double u = segment * (i + rnd->random_double_range(0.0, 1.0));
+        positions[i] = priorities->find(u);
+
+        double p = priorities->get(positions[i]) / total;
+        weights[i] = std::pow(size() * p, -beta) / max_weight;
+    }
+
+    return;
+}
+
+
+void ReplayBuffer::update_priorities(const std::vector<int>& positions, const std::vector<double>& td_errors)
+{
+    if(priorities == NULL)
+        return;
+
+    int i;
+    for(i = 0; i < (int)positions.size(); i++)
+    {
+        double p = std::pow(std::abs(td_errors[i]) + DEFAULT_PRIORITY_EPSILON, alpha);
+
+        priorities->set(positions[i], p);
+        max_priority = std::max(max_priority, p);
+    }
+
+    return;
+}
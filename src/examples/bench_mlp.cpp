@@ -0,0 +1,326 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+
+#include "mlp-cpp/funcs.h"
+#include "mlp-cpp/network.h"
+#include "utils/alloc_counter.h"
+
+#define MY_RANDOM_SEED 14264
+
+#define BENCH_WARMUP_CALLS 5
+#define BENCH_MIN_CALLS 10
+#define BENCH_MIN_SECONDS 0.02
+
+/* a case is reported as a regression when it is this many times slower than the baseline */
+#define DEFAULT_REGRESSION_THRESHOLD 1.25
+
+#define BENCH_CSV_HEADER "precision,network,batch,activation,loss,phase,calls,ns_per_op,allocs_per_op,gflops"
+
+
+/* BENCHMARK CASES */
+
+struct bench_activation_t
+{
+    std::string name;
+    std::pair<mlp_activation_t, mlp_activation_t> type_pair;
+};
+
+struct bench_loss_t
+{
+    std::string name;
+    mlp_loss_func_t function;
+};
+
+struct bench_result_t
+{
+    std::string precision;
+    std::string network;
+    int batch_size;
+    std::string activation;
+    std::string loss;
+    std::string phase;
+    unsigned long calls;
+    double ns_per_op;
+    double allocs_per_op;
+    double gflops;
+};
+
+
+/**
+ * @brief Call op until at least BENCH_MIN_CALLS calls and BENCH_MIN_SECONDS have passed, after BENCH_WARMUP_CALLS untimed
+ * calls which size the network workspace.
+ */
+template<typename Op>
+bench_result_t time_op(const bench_result_t& bench_case, const std::string& phase, double flops_per_op, Op op)
+{
+    int i;
+    for(i = 0; i < BENCH_WARMUP_CALLS; i++)
+        op();
+
+    unsigned long calls = 0;
+    unsigned long allocations_before = get_num_allocations();
+
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+
+    while((calls < BENCH_MIN_CALLS) || (elapsed.count() < BENCH_MIN_SECONDS))
+    {
+        op();
+        calls++;
+
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+
+    // read before copying bench_case, whose strings may allocate
+    unsigned long allocations = get_num_allocations() - allocations_before;
+
+    bench_result_t res = bench_case;
+    res.phase = phase;
+    res.calls = calls;
+    res.ns_per_op = (elapsed.count() * 1e9) / calls;
+    res.allocs_per_op = (double)allocations / calls;
+    res.gflops = flops_per_op / res.ns_per_op;
+
+    return res;
+}
+
+
+/**
+ * @brief Time forward propogation, dense and sparse deep q-learning back propogation and the weight update of one network.
+ * Flop counts only include the matrix products.
+ */
+template<typename Scalar>
+std::vector<bench_result_t> bench_network(const std::string& precision, const std::vector<int>& layer_config, int batch_size, const bench_activation_t& activation, const bench_loss_t& loss, rand_helper* rnd)
+{
+    typedef typename BasicMLP<Scalar>::matrix_t matrix_t;
+
+    int num_layers = layer_config.size();
+    int num_actions = layer_config.back();
+
+    std::string network = std::to_string(layer_config[0]);
+    int i;
+    for(i = 1; i < num_layers; i++)
+        network += "-" + std::to_string(layer_config[i]);
+
+    bench_result_t bench_case = {precision, network, batch_size, activation.name, loss.name};
+
+    // multiply adds of each weight matrix for the whole batch
+    double forward_flops = 0;
+    double update_flops = 0;
+    double backward_flops = 0;
+    for(i = 0; i < (num_layers - 1); i++)
+    {
+        double flops = 2.0 * batch_size * layer_config[i] * layer_config[i+1];
+
+        forward_flops += flops;
+        update_flops += flops;
+
+        // no gradient is propogated into the input layer
+        if(i > 0)
+            backward_flops += flops;
+    }
+
+    // the sparse path only uses one column of the last weights per row
+    double sparse_backward_flops = backward_flops - (2.0 * batch_size * layer_config[num_layers-2] * (num_actions - 1));
+
+    matrix_t states = matrix_t::Random(batch_size, layer_config[0]);
+    matrix_t targets = matrix_t::Zero(batch_size, num_actions);
+    std::vector<int> action_pos(batch_size);
+    std::vector<double> y(batch_size);
+
+    for(i = 0; i < batch_size; i++)
+    {
+        action_pos[i] = rnd->random_int_range(0, num_actions - 1);
+        y[i] = rnd->random_double_range(-1.0, 1.0);
+        targets(i, action_pos[i]) = y[i];
+    }
+
+    // small learning rate so repeated updates with the same gradient stay finite
+    BasicMLP<Scalar>* mlp = new BasicMLP<Scalar>(layer_config, activation.type_pair, he_normal_initialiser, loss.function, rnd, 1e-6);
+
+    std::vector<bench_result_t> results;
+
+    results.push_back(time_op(bench_case, "forward", forward_flops, [&]() { mlp->forward_propogate(states); }));
+
+    results.push_back(time_op(bench_case, "backward", backward_flops, [&]() { mlp->back_propogate_rl(targets, action_pos); }));
+
+    results.push_back(time_op(bench_case, "update", update_flops, [&]() { mlp->update_weights(); }));
+
+    results.push_back(time_op(bench_case, "backward_sparse", sparse_backward_flops, [&]() { mlp->back_propogate_rl_sparse(y, action_pos); }));
+
+    results.push_back(time_op(bench_case, "update_sparse", update_flops, [&]() { mlp->update_weights(); }));
+
+    results.push_back(time_op(bench_case, "train_step", forward_flops + backward_flops + update_flops, [&]()
+    {
+        mlp->forward_propogate(states);
+        mlp->back_propogate_rl(targets, action_pos);
+        mlp->update_weights();
+    }));
+
+    delete mlp;
+
+    return results;
+}
+
+
+/**
+ * @brief Csv columns identifying a result, used to match it against a baseline.
+ */
+std::string result_key(const bench_result_t& r)
+{
+    return r.precision + "," + r.network + "," + std::to_string(r.batch_size) + "," + r.activation + "," + r.loss + "," + r.phase;
+}
+
+
+/**
+ * @brief Read ns_per_op of every case in a csv written by a previous run, keyed by case and phase.
+ */
+std::map<std::string, double> read_baseline(const std::string& file_name)
+{
+    std::map<std::string, double> baseline;
+
+    std::ifstream file(file_name);
+    if(!file.is_open())
+    {
+        std::cerr << "Could not open baseline file " << file_name << ", exiting!\n";
+        std::exit(-1);
+    }
+
+    std::string line;
+    std::getline(file, line);
+
+    if(line != BENCH_CSV_HEADER)
+    {
+        std::cerr << "Baseline file " << file_name << " was not written by this version of bench_mlp, exiting!\n";
+        std::exit(-1);
+    }
+
+    while(std::getline(file, line))
+    {
+        std::vector<std::string> cols;
+        std::stringstream ss(line);
+        std::string col;
+
+        while(std::getline(ss, col, ','))
+            cols.push_back(col);
+
+        if(cols.size() != 10)
+            continue;
+
+        // precision,network,batch,activation,loss,phase
+        std::string key = cols[0] + "," + cols[1] + "," + cols[2] + "," + cols[3] + "," + cols[4] + "," + cols[5];
+        baseline[key] = std::stod(cols[7]);
+    }
+
+    return baseline;
+}
+
+
+/**
+ * @brief Microbenchmarks of network.cpp and funcs.cpp over a matrix of layer configs, batch sizes, activations, loss functions
+ * and precisions. A human readable table goes to stdout and every result is written as csv to the results file.
+ * Given a baseline csv from an earlier run, cases more than DEFAULT_REGRESSION_THRESHOLD times slower are listed and the
+ * exit code is 1.
+ * Usage: bench_mlp [results.csv] [baseline.csv]
+ */
+int main(int argc, char** argv)
+{
+    std::string results_file = (argc > 1) ? argv[1] : "bench_mlp_results.csv";
+
+    rand_helper* rnd = new rand_helper(MY_RANDOM_SEED);
+
+    std::vector<std::vector<int>> configs = {
+        {7, 30, 30, 30, 11},
+        {7, 64, 64, 64, 64},
+        {7, 256, 256, 256, 128}
+    };
+
+    std::vector<int> batch_sizes = {1, 32, 256};
+
+    std::vector<bench_activation_t> activations = {
+        {"relu", std::make_pair(MLP_ACTIVATION_RELU, MLP_ACTIVATION_LINEAR)},
+        {"sigmoid", std::make_pair(MLP_ACTIVATION_SIGMOID, MLP_ACTIVATION_LINEAR)}
+    };
+
+    std::vector<bench_loss_t> losses = {
+        {"dql_square", dql_square_loss},
+        {"dql_square_clipped", dql_square_loss_with_error_clipping},
+        {"huber", huber_loss}
+    };
+
+    std::vector<bench_result_t> results;
+
+    std::cout << std::left << std::setw(10) << "precision" << std::setw(18) << "network" << std::setw(7) << "batch" << std::setw(9) << "act" << std::setw(20) << "loss" << std::setw(17) << "phase" << std::setw(14) << "ns/op" << std::setw(12) << "allocs/op" << "GFLOP/s\n";
+
+    for(auto const& config : configs)
+    {
+        for(int batch_size : batch_sizes)
+        {
+            for(auto const& activation : activations)
+            {
+                for(auto const& loss : losses)
+                {
+                    std::vector<bench_result_t> case_results = bench_network<double>("double", config, batch_size, activation, loss, rnd);
+                    std::vector<bench_result_t> case_results_f = bench_network<float>("float", config, batch_size, activation, loss, rnd);
+                    case_results.insert(case_results.end(), case_results_f.begin(), case_results_f.end());
+
+                    for(auto const& r : case_results)
+                    {
+                        std::cout << std::setw(10) << r.precision << std::setw(18) << r.network << std::setw(7) << r.batch_size << std::setw(9) << r.activation << std::setw(20) << r.loss << std::setw(17) << r.phase << std::setw(14) << std::fixed << std::setprecision(0) << r.ns_per_op << std::setw(12) << std::setprecision(2) << r.allocs_per_op << std::setprecision(3) << r.gflops << '\n';
+                    }
+
+                    results.insert(results.end(), case_results.begin(), case_results.end());
+                }
+            }
+        }
+    }
+
+    delete rnd;
+
+    std::ofstream out(results_file);
+    if(!out.is_open())
+    {
+        std::cerr << "Could not open results file " << results_file << ", exiting!\n";
+        std::exit(-1);
+    }
+
+    out << BENCH_CSV_HEADER << '\n';
+    out << std::fixed;
+    for(auto const& r : results)
+        out << result_key(r) << ',' << r.calls << ',' << std::setprecision(1) << r.ns_per_op << ',' << std::setprecision(3) << r.allocs_per_op << ',' << std::setprecision(4) << r.gflops << '\n';
+
+    out.close();
+
+    std::cout << "\nResults written to " << results_file << '\n';
+
+    if(argc < 3)
+        return 0;
+
+    std::map<std::string, double> baseline = read_baseline(argv[2]);
+    int regressions = 0;
+
+    std::cout << "\nRegressions against " << argv[2] << " (threshold " << DEFAULT_REGRESSION_THRESHOLD << "x):\n";
+
+    for(auto const& r : results)
+    {
+        auto it = baseline.find(result_key(r));
+        if((it == baseline.end()) || (it->second <= 0))
+            continue;
+
+        double ratio = r.ns_per_op / it->second;
+        if(ratio > DEFAULT_REGRESSION_THRESHOLD)
+        {
+            std::cout << result_key(r) << "\t" << std::setprecision(2) << ratio << "x slower\n";
+            regressions++;
+        }
+    }
+
+    std::cout << regressions << " regression(s)\n";
+
+    return (regressions > 0) ? 1 : 0;
+}
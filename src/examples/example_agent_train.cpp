@@ -2,7 +2,10 @@
 
 #define MY_SEED 321
 
-int main()
+/**
+ * Usage: example_agent_train [num_envs], episodes are stepped num_envs at a time in separate environments (default 1).
+ */
+int main(int argc, char** argv)
 {
     // input layer - num features parsed in statetool
     // output layer - size of action space
@@ -28,10 +31,12 @@ int main()
 
     rand_helper* rnd = new rand_helper(MY_SEED);
 
-    Agent* ag = new Agent(network_config, actions, training_programs, buffer_size, copy_period, number_episodes, episode_length, discount_rate, learning_rate, rnd, true);
+    // transitions are kept in a replay store so later runs (and example_agent_offline) can reuse them
+    Agent* ag = new Agent(network_config, actions, training_programs, buffer_size, copy_period, number_episodes, episode_length, discount_rate, learning_rate, rnd, true, DEFAULT_BATCH_SIZE, DEFAULT_PRECISION, DEFAULT_OPTIMISER, DEFAULT_NUM_THREADS, DEFAULT_REPLAY_SAMPLING, DEFAULT_REPLAY_LOCATION);
 
     double epsilon = 0.3;
-    ag->train_optimiser(epsilon);
+    unsigned int num_envs = (argc > 1) ? std::atoi(argv[1]) : 1;
+    ag->train_optimiser_parallel(epsilon, num_envs);
 
     return 0;
 }
\ No newline at end of file
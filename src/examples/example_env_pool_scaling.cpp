@@ -0,0 +1,102 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+
+#include "utils/env_pool.h"
+#include "utils/rand_helper.h"
+
+#define MY_RANDOM_SEED 14264
+
+#define PROGRAM "2mm"
+#define BASELINE "-O1"
+#define NUM_FEATURES 7
+#define STEPS_PER_ENV 4
+
+
+/**
+ * @brief Step every environment of a pool of num_envs STEPS_PER_ENV times, each step applying the next optimisation of
+ * the shared action sequence and extracting the program state as Agent::train_optimiser_parallel does. Returns
+ * environment steps per second, final_states is set to each environment's last state for the isolation check.
+ */
+double time_stepping(int num_envs, const std::vector<std::string>& action_sequence, std::vector<std::vector<double>>& final_states)
+{
+    EnvironmentPool* pool = new EnvironmentPool(num_envs, PROGRAM, BASELINE);
+
+    auto start = std::chrono::steady_clock::now();
+
+    int i, k;
+    for(i = 0; i < STEPS_PER_ENV; i++)
+    {
+        for(k = 0; k < num_envs; k++)
+            pool->get_env(k)->optimisations.push_back(action_sequence[i]);
+
+        pool->get_states(num_envs, NUM_FEATURES, final_states);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    delete pool;
+
+    return (num_envs * STEPS_PER_ENV) / elapsed.count();
+}
+
+
+/**
+ * @brief Scaling of concurrent environment stepping (compile with statetool, extract state) over 1..N environments.
+ * Usage: example_env_pool_scaling [max_envs], defaults to the number of hardware threads. Requires PolyBench and statetool.
+ */
+int main(int argc, char** argv)
+{
+    int max_envs = (argc > 1) ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    if(max_envs < 1)
+        max_envs = 1;
+
+    std::vector<std::string> optimisations = read_file_to_vec(DEFAULT_OPTIMISATIONS_LIST_LOCATION);
+
+    rand_helper* rnd = new rand_helper(MY_RANDOM_SEED);
+
+    std::vector<std::string> action_sequence;
+    int i;
+    for(i = 0; i < STEPS_PER_ENV; i++)
+        action_sequence.push_back(optimisations[rnd->random_int_range(0, optimisations.size() - 1)]);
+
+    std::cout << "Program: " << PROGRAM << "\tSteps per environment: " << STEPS_PER_ENV << "\tMax environments: " << max_envs << "\n\n";
+    std::cout << std::left << std::setw(14) << "environments" << std::setw(14) << "steps/s" << std::setw(10) << "speedup" << "matches 1 environment\n";
+
+    std::vector<std::vector<double>> base_states, states;
+    double base_rate = 0;
+    bool isolated = true;
+
+    int n;
+    for(n = 1; n <= max_envs; n++)
+    {
+        double rate = time_stepping(n, action_sequence, (n == 1) ? base_states : states);
+
+        if(n == 1)
+            base_rate = rate;
+
+        // every environment applied the same optimisations so any difference means environments clobbered each other
+        bool same = true;
+        if(n > 1)
+        {
+            for(auto const& st : states)
+                same = same && (st == base_states[0]);
+        }
+
+        isolated = isolated && same;
+
+        std::cout << std::setw(14) << n << std::setw(14) << rate << std::setw(10) << (rate / base_rate) << (same ? "yes" : "NO") << '\n';
+    }
+
+    delete rnd;
+
+    if(!isolated)
+    {
+        std::cerr << "FAILED: environment states depend on the number of environments!\n";
+        return 1;
+    }
+
+    return 0;
+}
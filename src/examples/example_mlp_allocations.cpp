@@ -0,0 +1,111 @@
+#include <iostream>
+#include <cstdlib>
+
+#include "mlp-cpp/funcs.h"
+#include "mlp-cpp/network.h"
+#include "utils/alloc_counter.h"
+
+#define MY_RANDOM_SEED 14264
+
+#define WARMUP_STEPS 10
+#define MEASURED_STEPS 1000
+
+
+/**
+ * @brief Checks that a steady state minibatch training step (forward, back propogation and weight update) does no heap
+ * allocation, for every optimiser with both the dense and the sparse deep q-learning back propogation. Allocations are
+ * counted at the malloc level (see alloc_counter.h) so Eigen's matrices are seen as well as std containers, and a step
+ * which does allocate has to be caught first for a zero count to mean anything.
+ */
+int main(void)
+{
+    rand_helper* rnd = new rand_helper(MY_RANDOM_SEED);
+
+    int batch_size = 32;
+    int num_actions = 11;
+
+    std::vector<int> layer_config = {7, 30, 30, 30, num_actions};
+    std::pair<mlp_activation_func_t, mlp_activation_func_t> func_pair = std::make_pair(mlp_ReLU, mlp_linear);
+
+    std::vector<mlp_optimiser_t> optimisers = {MLP_OPTIMISER_SGD, MLP_OPTIMISER_MOMENTUM, MLP_OPTIMISER_RMSPROP, MLP_OPTIMISER_ADAM};
+
+    Eigen::MatrixXd states = Eigen::MatrixXd::Random(batch_size, layer_config[0]);
+    Eigen::MatrixXd targets = Eigen::MatrixXd::Zero(batch_size, num_actions);
+    std::vector<int> action_pos(batch_size);
+    std::vector<double> y(batch_size);
+
+    int i;
+    for(i = 0; i < batch_size; i++)
+    {
+        action_pos[i] = rnd->random_int_range(0, num_actions - 1);
+        y[i] = rnd->random_double_range(-1.0, 1.0);
+        targets(i, action_pos[i]) = y[i];
+    }
+
+    bool passed = true;
+
+    // negative checks, an Eigen temporary and a std container must both be counted
+    unsigned long before = get_num_allocations();
+    Eigen::MatrixXd scaled = states * 2.0;
+    unsigned long eigen_allocations = get_num_allocations() - before;
+
+    before = get_num_allocations();
+    std::vector<int>* copied = new std::vector<int>(action_pos);
+    unsigned long std_allocations = get_num_allocations() - before;
+    delete copied;
+
+    std::cout << "Allocations of a deliberately allocating Eigen step: " << eigen_allocations << ", std container step: " << std_allocations << '\n';
+
+    if((eigen_allocations == 0) || (std_allocations == 0))
+    {
+        std::cerr << "FAILED: allocation counter missed a deliberate allocation, was the program linked with ALLOC_COUNTER_LINK_FLAGS?\n";
+        return 1;
+    }
+
+    for(auto optimiser : optimisers)
+    {
+        for(bool sparse : {false, true})
+        {
+            MLP* mlp = new MLP(layer_config, func_pair, he_normal_initialiser, dql_square_loss_with_error_clipping, rnd, 0.001, optimiser);
+
+            auto train_step = [&]()
+            {
+                mlp->forward_propogate(states);
+
+                if(sparse)
+                    mlp->back_propogate_rl_sparse(y, action_pos);
+                else
+                    mlp->back_propogate_rl(targets, action_pos);
+
+                mlp->update_weights();
+            };
+
+            // first steps size the network workspace
+            for(i = 0; i < WARMUP_STEPS; i++)
+                train_step();
+
+            before = get_num_allocations();
+
+            for(i = 0; i < MEASURED_STEPS; i++)
+                train_step();
+
+            unsigned long allocations = get_num_allocations() - before;
+
+            std::cout << "Allocations over " << MEASURED_STEPS << " training steps (batch size " << batch_size << ", " << optimiser_to_string(optimiser) << ((sparse) ? ", sparse" : "") << "): " << allocations << '\n';
+
+            if(allocations != 0)
+            {
+                std::cerr << "FAILED: steady state training step allocates with the " << optimiser_to_string(optimiser) << " optimiser!\n";
+                passed = false;
+            }
+
+            delete mlp;
+        }
+    }
+
+    if(!passed)
+        return 1;
+
+    std::cout << "PASSED\n";
+    return 0;
+}
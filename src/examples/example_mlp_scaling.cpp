@@ -0,0 +1,155 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+
+#include "mlp-cpp/funcs.h"
+#include "mlp-cpp/network.h"
+#include "utils/utils.h"
+
+#define MY_RANDOM_SEED 14264
+
+#define BATCH_SIZE 256
+#define WARMUP_STEPS 5
+#define MEASURED_STEPS 200
+
+
+/**
+ * @brief Time MEASURED_STEPS minibatch training steps with the given number of threads (0 for single threaded).
+ * Returns steps per second, final_W is set to the output layer's incoming weights for the determinism check.
+ */
+double time_training(const std::vector<int>& layer_config, int num_threads, const Eigen::MatrixXd& states, const Eigen::MatrixXd& targets, const std::vector<int>& action_pos, Eigen::MatrixXd& final_W)
+{
+    // same seed every run so every thread count starts from the same weights
+    rand_helper* rnd = new rand_helper(MY_RANDOM_SEED);
+    MLP* mlp = new MLP(layer_config, std::make_pair(MLP_ACTIVATION_RELU, MLP_ACTIVATION_LINEAR), he_normal_initialiser, dql_square_loss_with_error_clipping, rnd, 0.0001);
+
+    mlp->set_num_threads(num_threads);
+
+    int i;
+    for(i = 0; i < WARMUP_STEPS; i++)
+    {
+        mlp->forward_propogate(states);
+        mlp->back_propogate_rl(targets, action_pos);
+        mlp->update_weights();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(i = 0; i < MEASURED_STEPS; i++)
+    {
+        mlp->forward_propogate(states);
+        mlp->back_propogate_rl(targets, action_pos);
+        mlp->update_weights();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    final_W = mlp->layers[mlp->num_layers-2]->W;
+
+    delete mlp;
+    delete rnd;
+
+    return MEASURED_STEPS / elapsed.count();
+}
+
+
+/**
+ * @brief Scaling of data parallel minibatch training over 1..N threads for networks up to the full action space in data/optimisations.txt.
+ * Usage: example_mlp_scaling [max_threads], defaults to the number of hardware threads.
+ */
+int main(int argc, char** argv)
+{
+    int max_threads = (argc > 1) ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    if(max_threads < 1)
+        max_threads = 1;
+
+    // to include NOP operation
+    int full_actions = read_file_to_vec("data/optimisations.txt").size() + 1;
+
+    std::vector<std::vector<int>> configs = {
+        {7, 30, 30, 30, 11},
+        {7, 30, 30, 30, full_actions / 2},
+        {7, 30, 30, 30, full_actions},
+        {7, 256, 256, 256, full_actions}
+    };
+
+    rand_helper* rnd = new rand_helper(MY_RANDOM_SEED);
+    bool deterministic = true;
+
+    std::cout << "Batch size: " << BATCH_SIZE << "\tShard rows: " << DEFAULT_SHARD_ROWS << "\tMax threads: " << max_threads << "\n\n";
+    std::cout << std::left << std::setw(24) << "network" << std::setw(10) << "threads" << std::setw(14) << "steps/s" << std::setw(10) << "speedup" << "matches 1 thread\n";
+
+    for(auto const& config : configs)
+    {
+        int num_actions = config.back();
+
+        Eigen::MatrixXd states = Eigen::MatrixXd::Random(BATCH_SIZE, config[0]);
+        Eigen::MatrixXd targets = Eigen::MatrixXd::Zero(BATCH_SIZE, num_actions);
+        std::vector<int> action_pos(BATCH_SIZE);
+
+        int i;
+        for(i = 0; i < BATCH_SIZE; i++)
+        {
+            action_pos[i] = rnd->random_int_range(0, num_actions - 1);
+            targets(i, action_pos[i]) = rnd->random_double_range(-1.0, 1.0);
+        }
+
+        std::string name = std::to_string(config[0]);
+        for(i = 1; i < config.size(); i++)
+            name += "-" + std::to_string(config[i]);
+
+        Eigen::MatrixXd serial_W, base_W, W;
+
+        double serial = time_training(config, 0, states, targets, action_pos, serial_W);
+        std::cout << std::setw(24) << name << std::setw(10) << "serial" << std::setw(14) << serial << std::setw(10) << 1.0 << "-\n";
+
+        int t;
+        for(t = 1; t <= max_threads; t++)
+        {
+            double rate = time_training(config, t, states, targets, action_pos, (t == 1) ? base_W : W);
+
+            // reduction is in shard order so every thread count must give identical weights
+            bool same = (t == 1) || (W == base_W);
+            deterministic = deterministic && same;
+
+            std::cout << std::setw(24) << name << std::setw(10) << t << std::setw(14) << rate << std::setw(10) << (rate / serial) << (same ? "yes" : "NO") << '\n';
+        }
+
+        std::cout << '\n';
+    }
+
+    // a minibatch that fits in one shard is not dispatched to the pool, so it must train exactly as single threaded
+    int small_actions = configs[0].back();
+
+    Eigen::MatrixXd small_states = Eigen::MatrixXd::Random(DEFAULT_SHARD_ROWS, configs[0][0]);
+    Eigen::MatrixXd small_targets = Eigen::MatrixXd::Zero(DEFAULT_SHARD_ROWS, small_actions);
+    std::vector<int> small_action_pos(DEFAULT_SHARD_ROWS);
+
+    int i;
+    for(i = 0; i < DEFAULT_SHARD_ROWS; i++)
+    {
+        small_action_pos[i] = rnd->random_int_range(0, small_actions - 1);
+        small_targets(i, small_action_pos[i]) = rnd->random_double_range(-1.0, 1.0);
+    }
+
+    Eigen::MatrixXd small_serial_W, small_W;
+    time_training(configs[0], 0, small_states, small_targets, small_action_pos, small_serial_W);
+    time_training(configs[0], max_threads, small_states, small_targets, small_action_pos, small_W);
+
+    bool small_same = (small_W == small_serial_W);
+    deterministic = deterministic && small_same;
+
+    std::cout << "Single shard minibatch (" << DEFAULT_SHARD_ROWS << " rows) with " << max_threads << " threads matches serial: " << (small_same ? "yes" : "NO") << '\n';
+
+    delete rnd;
+
+    if(!deterministic)
+    {
+        std::cerr << "FAILED: weights depend on the number of threads!\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <chrono>
+
+#include "dqn/Agent.h"
+
+#define MY_SEED 12349
+
+#define ROLLOUT_LENGTH 6
+
+
+/**
+ * @brief Collect the states visited by the double precision policy on program_name, starting from the unoptimised program.
+ */
+std::vector<std::vector<double>> policy_states(const MLP* policy_net, const std::string& program_name, const std::vector<std::string>& actions)
+{
+    std::vector<std::vector<double>> states;
+    MLP::inference_scratch_t scratch;
+
+    PolyString* env = construct_polybench_PolyString(program_name, "-O1");
+    int num_features = policy_net->layers[0]->W.rows();
+
+    int i;
+    for(i = 0; i < ROLLOUT_LENGTH; i++)
+    {
+        std::vector<double> st = vec_min_max_scaling(get_program_state(env, num_features));
+        states.push_back(st);
+
+        int best_pos = Agent::best_q_action(policy_net->infer(st, scratch), actions.size());
+        env->optimisations.push_back(actions[best_pos]);
+    }
+
+    delete env;
+
+    return states;
+}
+
+
+/**
+ * @brief Quantize a trained policy to int8 and report how often it picks the same action as the double precision network
+ * over the states seen across the program space.
+ * Usage: example_quantized_policy [weights file], text weights or binary checkpoint.
+ */
+int main(int argc, char** argv)
+{
+    std::string weights_file = (argc > 1) ? argv[1] : DEFAULT_WEIGHT_SAVE_LOCATION;
+
+    std::vector<std::string> actions = read_file_to_vec("data/action_spaces/LOOPS_CSE_actionspace.txt");
+    actions.push_back(NOP);
+
+    std::vector<std::string> programs = read_file_to_vec("data/program_spaces/training_programs_loops_cse.txt");
+    std::vector<std::string> testing_programs = read_file_to_vec("data/program_spaces/testing_programs_loops_cse.txt");
+    programs.insert(programs.end(), testing_programs.begin(), testing_programs.end());
+
+    std::vector<int> network_config = {7, 30, 30, 30, (int)actions.size()};
+
+    MLP* policy_net = new MLP(network_config, std::make_pair(DEFAULT_HIDDEN_ACTIVATION, DEFAULT_OUTPUT_ACTIVATION), DEFAULT_INITIALISOR, DEFAULT_LOSS_FUNCTION, new rand_helper(MY_SEED), 0.001);
+
+    if(is_checkpoint_file(weights_file))
+        load_checkpoint(policy_net, weights_file);
+    else
+        load_weights(policy_net, weights_file);
+
+    // offline quantization step
+    QuantizedMLP* q_policy_net = new QuantizedMLP(policy_net);
+
+    std::vector<std::vector<double>> all_states;
+
+    std::cout << "Program\tStates\tArgmax agreement\tMax abs error\n";
+
+    for(auto const& program_name : programs)
+    {
+        std::vector<std::vector<double>> states = policy_states(policy_net, program_name, actions);
+        quantization_report_t report = compare_quantized(policy_net, q_policy_net, states);
+
+        std::cout << program_name << '\t' << report.num_states << '\t' << report.argmax_agreement << "/" << report.num_states << '\t' << report.max_abs_error << '\n';
+
+        all_states.insert(all_states.end(), states.begin(), states.end());
+    }
+
+    quantization_report_t report = compare_quantized(policy_net, q_policy_net, all_states);
+
+    std::cout << "\nTotal states: " << report.num_states << '\n';
+    std::cout << "Argmax agreement: " << report.argmax_agreement << "/" << report.num_states << " (" << (100.0 * report.argmax_agreement) / std::max(report.num_states, 1) << "%)\n";
+    std::cout << "Max abs Q error: " << report.max_abs_error << "\tMean abs Q error: " << report.mean_abs_error << '\n';
+
+    // per state inference cost of both networks
+    MLP::inference_scratch_t scratch;
+    QuantizedMLP::inference_scratch_t q_scratch;
+
+    int repeats = 1000;
+    double checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < repeats; i++)
+        for(auto const& st : all_states)
+            checksum += policy_net->infer(st, scratch)(0, 0);
+    std::chrono::duration<double, std::nano> double_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < repeats; i++)
+        for(auto const& st : all_states)
+            checksum += q_policy_net->infer(st, q_scratch)(0, 0);
+    std::chrono::duration<double, std::nano> int8_time = std::chrono::steady_clock::now() - start;
+
+    int lookups = repeats * std::max((int)all_states.size(), 1);
+    std::cout << "Inference ns/state - double: " << double_time.count() / lookups << "\tint8: " << int8_time.count() / lookups << "\t(checksum " << checksum << ")\n";
+
+    delete q_policy_net;
+    delete policy_net;
+
+    return 0;
+}
@@ -16,9 +16,14 @@ int main()
 
     std::cout << "RANDOM OPTIMISER\n";
     std::cout << "Progam name: " << program_name << "\n";
-    std::vector<std::string> rand_opts = random_optimiser(program_name, actions, baseline, 100, rnd);
+    // runtimes are shared with earlier runs and the agent through the evaluation cache
+    EvalCache* eval_cache = new EvalCache(DEFAULT_EVAL_CACHE_LOCATION);
+
+    std::vector<std::string> rand_opts = random_optimiser(program_name, actions, baseline, 100, rnd, eval_cache);
     std::cout << opt_vec_to_string(rand_opts) << "\n";
 
+    delete eval_cache;
+
 
     return 0;
 }
\ No newline at end of file
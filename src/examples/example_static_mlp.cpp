@@ -0,0 +1,171 @@
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+
+#include "mlp-cpp/funcs.h"
+#include "mlp-cpp/network.h"
+#include "mlp-cpp/static_network.h"
+
+#define MY_RANDOM_SEED 14264
+
+#define TRAIN_STEPS 200
+#define TOLERANCE 1E-09
+
+#define MLP_WEIGHTS_FILE "bin/example_static_mlp_dynamic.txt"
+#define STATIC_WEIGHTS_FILE "bin/example_static_mlp_static.txt"
+
+typedef StaticMLP<7, 30, 30, 30, 11> static_net_t;
+
+
+/**
+ * @brief Largest absolute difference between the weights of net and snet, scratch is an MLP of the same layout that
+ * snet's weights are copied into to compare them.
+ */
+double max_weight_diff(const MLP* net, const static_net_t* snet, MLP* scratch)
+{
+    snet->copy_weights_to(scratch);
+
+    double diff = 0;
+
+    int i;
+    for(i = 0; i < (net->num_layers - 1); i++)
+        diff = std::max(diff, (net->layers[i]->W - scratch->layers[i]->W).cwiseAbs().maxCoeff());
+
+    return diff;
+}
+
+
+double max_output_diff(const Eigen::MatrixXd& lhs, const static_net_t::output_t& rhs)
+{
+    return (lhs - rhs).cwiseAbs().maxCoeff();
+}
+
+
+/**
+ * @brief Checks that StaticMLP<7, 30, 30, 30, 11> behaves as the MLP it specialises: built from the same seed the two
+ * networks start with the same weights, give the same outputs through forward propogation and stay equal through deep
+ * q-learning back propogation and (sgd) weight updates. Weights saved by either type load into the other.
+ */
+int main(void)
+{
+    int num_actions = static_net_t::num_outputs;
+    double learning_rate = 0.001;
+
+    std::vector<int> layer_config = {7, 30, 30, 30, num_actions};
+    std::pair<mlp_activation_t, mlp_activation_t> type_pair = std::make_pair(MLP_ACTIVATION_RELU, MLP_ACTIVATION_LINEAR);
+
+    rand_helper* mlp_rnd = new rand_helper(MY_RANDOM_SEED);
+    rand_helper* static_rnd = new rand_helper(MY_RANDOM_SEED);
+    rand_helper* data_rnd = new rand_helper(MY_RANDOM_SEED + 1);
+
+    MLP* mlp = new MLP(layer_config, type_pair, he_normal_initialiser, dql_square_loss_with_error_clipping, mlp_rnd, learning_rate, MLP_OPTIMISER_SGD);
+    static_net_t* snet = new static_net_t(he_normal_initialiser, static_rnd, learning_rate);
+
+    MLP* scratch = new MLP(layer_config, type_pair, he_normal_initialiser, dql_square_loss_with_error_clipping, data_rnd, learning_rate, MLP_OPTIMISER_SGD);
+
+    // checks are written as !(diff <= tolerance) so a network gone to NaN fails them
+    bool passed = true;
+
+    /* INITIAL WEIGHTS */
+
+    double diff = max_weight_diff(mlp, snet, scratch);
+    std::cout << "Initial weights, max difference: " << diff << '\n';
+
+    if(!(diff <= TOLERANCE))
+    {
+        std::cerr << "FAILED: same seed gave different initial weights!\n";
+        passed = false;
+    }
+
+    /* TRAINING - single sample steps, the only batch size StaticMLP has */
+
+    std::vector<double> state(layer_config[0]);
+    Eigen::MatrixXd yj = Eigen::MatrixXd::Zero(1, num_actions);
+    static_net_t::output_t static_yj;
+
+    double max_forward_diff = 0;
+
+    int i, j;
+    for(i = 0; i < TRAIN_STEPS; i++)
+    {
+        for(j = 0; j < layer_config[0]; j++)
+            state[j] = data_rnd->random_double_range(0.0, 1.0);
+
+        int action_pos = data_rnd->random_int_range(0, num_actions - 1);
+
+        const Eigen::MatrixXd& out = mlp->forward_propogate(state);
+        const static_net_t::output_t& static_out = snet->forward_propogate(state);
+
+        max_forward_diff = std::max(max_forward_diff, max_output_diff(out, static_out));
+
+        // only the chosen action carries a target, as in Agent's minibatches
+        yj.setZero();
+        yj(0, action_pos) = data_rnd->random_double_range(-1.0, 1.0);
+        static_yj = yj;
+
+        mlp->back_propogate_rl(yj, action_pos);
+        snet->back_propogate_rl(static_yj, action_pos);
+
+        mlp->update_weights();
+        snet->update_weights();
+    }
+
+    diff = max_weight_diff(mlp, snet, scratch);
+    std::cout << "After " << TRAIN_STEPS << " training steps, max output difference: " << max_forward_diff << ", max weight difference: " << diff << '\n';
+
+    if(!(max_forward_diff <= TOLERANCE) || !(diff <= TOLERANCE))
+    {
+        std::cerr << "FAILED: StaticMLP and MLP diverged during training!\n";
+        passed = false;
+    }
+
+    /* SAVING AND LOADING - each type loads the other's weights */
+
+    save_weights(mlp, MLP_WEIGHTS_FILE);
+    save_weights(snet, STATIC_WEIGHTS_FILE);
+
+    rand_helper* load_rnd = new rand_helper(MY_RANDOM_SEED + 2);
+
+    MLP* loaded_mlp = new MLP(layer_config, type_pair, he_normal_initialiser, dql_square_loss_with_error_clipping, load_rnd, learning_rate, MLP_OPTIMISER_SGD);
+    static_net_t* loaded_snet = new static_net_t(he_normal_initialiser, load_rnd, learning_rate);
+
+    load_weights(loaded_mlp, STATIC_WEIGHTS_FILE);
+    load_weights(loaded_snet, MLP_WEIGHTS_FILE);
+
+    // the text format is not exact, compare against the trained networks to the precision written
+    double mlp_diff = max_weight_diff(loaded_mlp, snet, scratch);
+    double static_diff = max_weight_diff(mlp, loaded_snet, scratch);
+
+    for(j = 0; j < layer_config[0]; j++)
+        state[j] = data_rnd->random_double_range(0.0, 1.0);
+
+    double out_diff = max_output_diff(loaded_mlp->forward_propogate(state), loaded_snet->forward_propogate(state));
+
+    std::cout << "StaticMLP weights loaded into MLP, max difference: " << mlp_diff << '\n';
+    std::cout << "MLP weights loaded into StaticMLP, max difference: " << static_diff << ", loaded networks max output difference: " << out_diff << '\n';
+
+    if(!(mlp_diff <= 1E-04) || !(static_diff <= 1E-04) || !(out_diff <= 1E-03))
+    {
+        std::cerr << "FAILED: weights did not round trip between MLP and StaticMLP!\n";
+        passed = false;
+    }
+
+    std::remove(MLP_WEIGHTS_FILE);
+    std::remove(STATIC_WEIGHTS_FILE);
+
+    delete scratch;
+    delete loaded_mlp;
+    delete loaded_snet;
+    delete mlp;
+    delete snet;
+    delete mlp_rnd;
+    delete static_rnd;
+    delete data_rnd;
+    delete load_rnd;
+
+    if(!passed)
+        return 1;
+
+    std::cout << "PASSED\n";
+    return 0;
+}
@@ -0,0 +1,436 @@
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mlp-cpp/checkpoint.h"
+
+
+/* HELPERS */
+
+
+static uint64_t fnv1a_64(const char* data, std::size_t n)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    std::size_t i;
+    for(i = 0; i < n; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+
+static std::size_t align_up(std::size_t n)
+{
+    return ((n + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT) * CHECKPOINT_ALIGNMENT;
+}
+
+
+template<typename Scalar>
+static checkpoint_dtype_t dtype_of();
+
+template<>
+checkpoint_dtype_t dtype_of<float>() { return CHECKPOINT_DTYPE_FLOAT32; }
+
+template<>
+checkpoint_dtype_t dtype_of<double>() { return CHECKPOINT_DTYPE_FLOAT64; }
+
+
+/* copy a column major tensor from the mapped file into a network matrix of any scalar type */
+template<typename FileScalar, typename Scalar>
+static void read_tensor(const char* src, typename BasicLayer<Scalar>::param_map_t& dst)
+{
+    dst = Eigen::Map<const mlp_matrix_t<FileScalar>>((const FileScalar*)src, dst.rows(), dst.cols()).template cast<Scalar>();
+}
+
+
+/* tensor kinds written for an optimiser, in file order, each kind has one tensor per layer */
+static std::vector<checkpoint_tensor_kind_t> tensor_kinds(mlp_optimiser_t optimiser)
+{
+    std::vector<checkpoint_tensor_kind_t> kinds = {CHECKPOINT_TENSOR_WEIGHTS};
+
+    if(optimiser_uses_M(optimiser))
+        kinds.push_back(CHECKPOINT_TENSOR_OPTIMISER_M);
+    if(optimiser_uses_V(optimiser))
+        kinds.push_back(CHECKPOINT_TENSOR_OPTIMISER_V);
+
+    return kinds;
+}
+
+
+/* layer matrix a tensor kind is stored in */
+template<typename Scalar>
+static typename BasicLayer<Scalar>::param_map_t& tensor_matrix(BasicLayer<Scalar>* layer, uint32_t kind)
+{
+    if(kind == CHECKPOINT_TENSOR_OPTIMISER_M)
+        return layer->M;
+    if(kind == CHECKPOINT_TENSOR_OPTIMISER_V)
+        return layer->V;
+
+    return layer->W;
+}
+
+
+/* network slab holding every layer's tensor of a kind, in the same layout as the file */
+template<typename Scalar>
+static Scalar* tensor_slab(const BasicMLP<Scalar>* net, uint32_t kind)
+{
+    if(kind == CHECKPOINT_TENSOR_OPTIMISER_M)
+        return net->M_slab;
+    if(kind == CHECKPOINT_TENSOR_OPTIMISER_V)
+        return net->V_slab;
+
+    return net->weight_slab;
+}
+
+
+/* SAVING AND LOADING */
+
+static_assert(CHECKPOINT_ALIGNMENT == MLP_SLAB_ALIGNMENT, "network slabs are written to checkpoints as they are");
+
+
+template<typename Scalar>
+std::vector<char> serialise_checkpoint(const BasicMLP<Scalar>* net)
+{
+    int num_weights = net->num_layers - 1;
+    std::vector<checkpoint_tensor_kind_t> kinds = tensor_kinds(net->optimiser);
+    int num_tensors = num_weights * kinds.size();
+
+    // work out the file layout, every optimiser state matrix has the shape of its weights
+    std::size_t offset = align_up(sizeof(checkpoint_header_t) + (num_tensors * sizeof(checkpoint_tensor_t)));
+
+    std::vector<std::size_t> tensor_offsets(num_tensors);
+
+    int i;
+    for(i = 0; i < num_tensors; i++)
+    {
+        tensor_offsets[i] = offset;
+        offset = align_up(offset + (net->layers[i % num_weights]->W.size() * sizeof(Scalar)));
+    }
+
+    std::vector<char> data(offset, 0);
+
+    // shape table
+    checkpoint_tensor_t* table = (checkpoint_tensor_t*)(data.data() + sizeof(checkpoint_header_t));
+    for(i = 0; i < num_tensors; i++)
+    {
+        const BasicLayer<Scalar>* l = net->layers[i % num_weights];
+
+        table[i].kind = kinds[i / num_weights];
+        table[i].layer = i % num_weights;
+        table[i].rows = l->W.rows();
+        table[i].cols = l->W.cols();
+    }
+
+    // tensors, each kind's tensors are padded like the network's slab so the whole slab is one copy
+    for(i = 0; i < kinds.size(); i++)
+        std::memcpy(data.data() + tensor_offsets[i * num_weights], tensor_slab(net, kinds[i]), net->slab_size * sizeof(Scalar));
+
+    // header last so the checksum covers the rest of the file
+    checkpoint_header_t header;
+    std::memset(&header, 0, sizeof(header));
+    std::strncpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.dtype = dtype_of<Scalar>();
+    header.num_tensors = num_tensors;
+    header.optimiser = net->optimiser;
+    header.optimiser_step = net->optimiser_step;
+    header.file_size = data.size();
+    header.checksum = fnv1a_64(data.data() + sizeof(checkpoint_header_t), data.size() - sizeof(checkpoint_header_t));
+
+    std::memcpy(data.data(), &header, sizeof(header));
+
+    return data;
+}
+
+
+/* write the complete file to filename.tmp then rename into place */
+static bool write_checkpoint_data(const std::vector<char>& data, const std::string& filename)
+{
+    std::string tmp_filename = filename + ".tmp";
+    std::ofstream output_file(tmp_filename.c_str(), std::ios::binary | std::ios::trunc);
+
+    if(!(output_file.is_open()))
+    {
+        std::cerr << "FILENAME ENTERED IS NOT VALID! CANNOT WRITE CHECKPOINT TO FILE\n";
+        return false;
+    }
+
+    output_file.write(data.data(), data.size());
+    output_file.close();
+
+    if(!output_file)
+    {
+        std::cerr << "ERROR WRITING CHECKPOINT TO FILE: " << tmp_filename << '\n';
+        return false;
+    }
+
+    if(std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+    {
+        std::cerr << "ERROR RENAMING CHECKPOINT TO: " << filename << '\n';
+        return false;
+    }
+
+    return true;
+}
+
+
+template<typename Scalar>
+bool save_checkpoint(const BasicMLP<Scalar>* net, const std::string& filename)
+{
+    return write_checkpoint_data(serialise_checkpoint(net), filename);
+}
+
+
+template<typename Scalar>
+bool load_checkpoint(BasicMLP<Scalar>* net, const std::string& filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        std::cerr << "FILENAME ENTERED IS NOT VALID! CANNOT READ CHECKPOINT FROM FILE\n";
+        return false;
+    }
+
+    struct stat st;
+    if((fstat(fd, &st) != 0) || (st.st_size < (off_t)CHECKPOINT_V1_HEADER_SIZE))
+    {
+        std::cerr << "CHECKPOINT FILE IS TOO SMALL: " << filename << '\n';
+        close(fd);
+        return false;
+    }
+
+    std::size_t size = st.st_size;
+    void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(mapped == MAP_FAILED)
+    {
+        std::cerr << "ERROR MAPPING CHECKPOINT FILE: " << filename << '\n';
+        return false;
+    }
+
+    const char* base = (const char*)mapped;
+
+    // version 1 headers are shorter, fields they do not have read as zero
+    checkpoint_header_t header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(&header, base, CHECKPOINT_V1_HEADER_SIZE);
+
+    std::size_t header_size = (header.version == 1) ? CHECKPOINT_V1_HEADER_SIZE : sizeof(checkpoint_header_t);
+    if((header.version != 1) && (size >= header_size))
+        std::memcpy(&header, base, header_size);
+
+    const checkpoint_tensor_t* table = (const checkpoint_tensor_t*)(base + header_size);
+
+    int num_weights = net->num_layers - 1;
+    mlp_optimiser_t file_optimiser = (mlp_optimiser_t)header.optimiser;
+    std::vector<checkpoint_tensor_kind_t> kinds = tensor_kinds(file_optimiser);
+
+    // validate everything before touching the network
+    std::string error;
+    if(std::strncmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0)
+        error = "not a checkpoint file";
+    else if((header.version != 1) && (header.version != CHECKPOINT_VERSION))
+        error = "unsupported checkpoint version " + std::to_string(header.version);
+    else if(header.file_size != size)
+        error = "file is truncated";
+    else if((header.dtype != CHECKPOINT_DTYPE_FLOAT32) && (header.dtype != CHECKPOINT_DTYPE_FLOAT64))
+        error = "unknown dtype";
+    else if(header.optimiser > MLP_OPTIMISER_ADAM)
+        error = "unknown optimiser";
+    else if(header.num_tensors != (num_weights * kinds.size()))
+        error = "number of layers does not match network";
+    else if((header_size + (header.num_tensors * sizeof(checkpoint_tensor_t))) > size)
+        error = "file is truncated";
+    else if(fnv1a_64(base + header_size, size - header_size) != header.checksum)
+        error = "checksum mismatch";
+
+    std::size_t elem_size = (header.dtype == CHECKPOINT_DTYPE_FLOAT32) ? sizeof(float) : sizeof(double);
+
+    // shapes, optimiser state has the shape of its layer's weights
+    std::vector<std::size_t> tensor_offsets(error.empty() ? header.num_tensors : 0);
+    std::size_t offset = align_up(header_size + (tensor_offsets.size() * sizeof(checkpoint_tensor_t)));
+
+    int i;
+    for(i = 0; (i < tensor_offsets.size()) && error.empty(); i++)
+    {
+        const mlp_matrix_t<Scalar>& W = net->layers[i % num_weights]->W;
+
+        if((table[i].kind != kinds[i / num_weights]) || (table[i].layer != (i % num_weights)))
+            error = "unexpected tensor in checkpoint";
+        else if((table[i].rows != W.rows()) || (table[i].cols != W.cols()))
+            error = "layer " + std::to_string(i % num_weights) + " shape " + std::to_string(table[i].rows) + "x" + std::to_string(table[i].cols) + " does not match network";
+
+        tensor_offsets[i] = offset;
+        offset = align_up(offset + ((std::size_t)table[i].rows * table[i].cols * elem_size));
+    }
+
+    if(error.empty() && (offset > size))
+        error = "file is truncated";
+
+    if(!error.empty())
+    {
+        std::cerr << "CANNOT LOAD CHECKPOINT " << filename << ": " << error << '\n';
+        munmap(mapped, size);
+        return false;
+    }
+
+    // optimiser state only carries over to the same optimiser
+    bool load_state = (file_optimiser == net->optimiser);
+    if(!load_state)
+    {
+        std::cerr << "Checkpoint " << filename << " was written with the " << optimiser_to_string(file_optimiser) << " optimiser, network uses " << optimiser_to_string(net->optimiser) << ". Optimiser state reset.\n";
+        net->set_optimiser(net->optimiser);
+    }
+
+    // a file of the network's precision is laid out like its slabs, one copy per kind, otherwise tensors are converted
+    bool same_dtype = (header.dtype == dtype_of<Scalar>());
+
+    for(i = 0; i < tensor_offsets.size(); i++)
+    {
+        if((table[i].kind != CHECKPOINT_TENSOR_WEIGHTS) && !load_state)
+            continue;
+
+        if(same_dtype)
+        {
+            if(table[i].layer == 0)
+                std::memcpy(tensor_slab(net, table[i].kind), base + tensor_offsets[i], net->slab_size * sizeof(Scalar));
+
+            continue;
+        }
+
+        typename BasicLayer<Scalar>::param_map_t& dst = tensor_matrix(net->layers[table[i].layer], table[i].kind);
+
+        if(header.dtype == CHECKPOINT_DTYPE_FLOAT32)
+            read_tensor<float, Scalar>(base + tensor_offsets[i], dst);
+        else
+            read_tensor<double, Scalar>(base + tensor_offsets[i], dst);
+    }
+
+    if(load_state)
+        net->optimiser_step = header.optimiser_step;
+
+    munmap(mapped, size);
+    return true;
+}
+
+
+bool is_checkpoint_file(const std::string& filename)
+{
+    std::ifstream input_file(filename.c_str(), std::ios::binary);
+
+    char magic[8];
+    if(!(input_file.read(magic, sizeof(magic))))
+        return false;
+
+    return std::strncmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0;
+}
+
+
+/* ASYNCHRONOUS CHECKPOINT WRITER */
+
+
+CheckpointWriter::CheckpointWriter()
+: writing(false), stopping(false)
+{
+    worker = std::thread(&CheckpointWriter::run, this);
+}
+
+
+CheckpointWriter::~CheckpointWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+
+    // remaining checkpoints are written before the worker exits
+    worker.join();
+}
+
+
+template<typename Scalar>
+void CheckpointWriter::save(const BasicMLP<Scalar>* net, const std::string& filename)
+{
+    // snapshot in the calling thread so training can carry on updating the weights
+    std::vector<char> data = serialise_checkpoint(net);
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        // replace an older snapshot of the same file that has not been written yet
+        bool replaced = false;
+        for(auto& p : pending)
+        {
+            if(p.filename == filename)
+            {
+                p.data.swap(data);
+                replaced = true;
+                break;
+            }
+        }
+
+        if(!replaced)
+            pending.push_back({filename, std::move(data)});
+    }
+
+    cv.notify_all();
+}
+
+
+void CheckpointWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this]() { return pending.empty() && !writing; });
+}
+
+
+void CheckpointWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+
+    while(true)
+    {
+        cv.wait(lock, [this]() { return stopping || !pending.empty(); });
+
+        if(pending.empty() && stopping)
+            break;
+
+        pending_t next = std::move(pending.front());
+        pending.erase(pending.begin());
+        writing = true;
+
+        // write without holding the lock so save() never waits on disk
+        lock.unlock();
+        write_checkpoint_data(next.data, next.filename);
+        lock.lock();
+
+        writing = false;
+        cv.notify_all();
+    }
+}
+
+
+/* EXPLICIT INSTANTIATIONS */
+
+
+template std::vector<char> serialise_checkpoint<float>(const BasicMLP<float>* net);
+template std::vector<char> serialise_checkpoint<double>(const BasicMLP<double>* net);
+
+template bool save_checkpoint<float>(const BasicMLP<float>* net, const std::string& filename);
+template bool save_checkpoint<double>(const BasicMLP<double>* net, const std::string& filename);
+
+template bool load_checkpoint<float>(BasicMLP<float>* net, const std::string& filename);
+template bool load_checkpoint<double>(BasicMLP<double>* net, const std::string& filename);
+
+template void CheckpointWriter::save<float>(const BasicMLP<float>* net, const std::string& filename);
+template void CheckpointWriter::save<double>(const BasicMLP<double>* net, const std::string& filename);
@@ -1,33 +1,62 @@
 
+#include <iostream>
+
 #include "mlp-cpp/funcs.h"
 
-Eigen::MatrixXd mlp_sigmoid(const Eigen::MatrixXd& input, bool deriv)
+template<typename Scalar>
+void mlp_activate(mlp_activation_t type, const mlp_matrix_t<Scalar>& input, mlp_matrix_t<Scalar>& value, mlp_matrix_t<Scalar>& deriv)
 {
-    Eigen::MatrixXd res(input.rows(), input.cols());
-    int i, j;
-
-    if(deriv)
+    switch(type)
     {
-        Eigen::MatrixXd unprime_sig = mlp_sigmoid(input, false);
+        case MLP_ACTIVATION_LINEAR:
+            mlp_activate<MLP_ACTIVATION_LINEAR>(input, value, deriv);
+            break;
+        case MLP_ACTIVATION_RELU:
+            mlp_activate<MLP_ACTIVATION_RELU>(input, value, deriv);
+            break;
+        case MLP_ACTIVATION_SIGMOID:
+            mlp_activate<MLP_ACTIVATION_SIGMOID>(input, value, deriv);
+            break;
+        default:
+            std::cerr << "Custom activation functions have no fused kernel, exiting!\n";
+            std::exit(-1);
+    }
+}
 
-        for(i = 0; i < res.rows(); i++)
-        {
-            for(j = 0; j < res.cols(); j++)
-            {
-                res(i, j) = unprime_sig(i, j) * (1 - unprime_sig(i, j));
-            }
-        }
+template void mlp_activate<float>(mlp_activation_t, const mlp_matrix_t<float>&, mlp_matrix_t<float>&, mlp_matrix_t<float>&);
+template void mlp_activate<double>(mlp_activation_t, const mlp_matrix_t<double>&, mlp_matrix_t<double>&, mlp_matrix_t<double>&);
 
-        return res;
-    }
 
-    for(i = 0; i < res.rows(); i++)
+template<typename Scalar>
+void mlp_activate_value(mlp_activation_t type, mlp_matrix_t<Scalar>& value)
+{
+    switch(type)
     {
-        for(j = 0; j < res.cols(); j++)
-        {
-            res(i, j) = 1 / (1 + exp(-(input(i, j))));
-        }
+        case MLP_ACTIVATION_LINEAR:
+            mlp_activate_value<MLP_ACTIVATION_LINEAR>(value);
+            break;
+        case MLP_ACTIVATION_RELU:
+            mlp_activate_value<MLP_ACTIVATION_RELU>(value);
+            break;
+        case MLP_ACTIVATION_SIGMOID:
+            mlp_activate_value<MLP_ACTIVATION_SIGMOID>(value);
+            break;
+        default:
+            std::cerr << "Custom activation functions have no fused kernel, exiting!\n";
+            std::exit(-1);
     }
+}
+
+template void mlp_activate_value<float>(mlp_activation_t, mlp_matrix_t<float>&);
+template void mlp_activate_value<double>(mlp_activation_t, mlp_matrix_t<double>&);
+
+
+Eigen::MatrixXd mlp_sigmoid(const Eigen::MatrixXd& input, bool deriv)
+{
+    Eigen::MatrixXd res = (1.0 + (-input.array()).exp()).inverse().matrix();
+
+    if(deriv)
+        res.array() *= (1.0 - res.array());
 
     return res;
 }
@@ -41,37 +70,10 @@ Eigen::MatrixXd mlp_sigmoid(const Eigen::MatrixXd& input, bool deriv)
 
 Eigen::MatrixXd mlp_ReLU(const Eigen::MatrixXd& input, bool deriv)
 {
-    Eigen::MatrixXd res(input.rows(), input.cols());
-
-    int i, j;
     if(deriv)
-    {
-        for(i = 0; i < res.rows(); i++)
-        {
-            for(j = 0; j < res.cols(); j++)
-            {
-                if(input(i, j) <= 0)
-                    res(i, j) = 0;
-                else
-                    res(i, j) = 1;
-            }
-        }
-
-        return res;
-    }
+        return (input.array() > 0).cast<double>().matrix();
 
-    for(i = 0; i < res.rows(); i++)
-    {
-        for(j = 0; j < res.cols(); j++)
-        {
-            if(input(i, j) <= 0)
-                res(i, j) = 0;
-            else
-                res(i, j) = input(i, j);
-        }
-    }
-
-    return res;
+    return input.cwiseMax(0.0);
 }
 
 
@@ -91,30 +93,18 @@ Eigen::MatrixXd mlp_linear(const Eigen::MatrixXd& input, bool deriv)
 
 void xiaver_initialiser(Eigen::MatrixXd& mat, int fan_in, int fan_out, rand_helper* rnd)
 {
-    int i, j;
-    for(i = 0; i < mat.rows(); i++)
-    {
-        for(j = 0; j < mat.cols(); j++)
-        {
-            double rhs = std::sqrt(6.0 / (fan_in + fan_out));
-            double lhs = -(rhs);
-            mat(i, j) = rnd->random_double_range(lhs, rhs);
-        }
-    }
+    double rhs = std::sqrt(6.0 / (fan_in + fan_out));
+    double lhs = -(rhs);
+
+    rnd->fill_double_range(mat.data(), mat.size(), lhs, rhs);
 }
 
 
 void he_normal_initialiser(Eigen::MatrixXd& mat, int fan_in, int fan_out, rand_helper* rnd)
 {
-    int i, j;
-    for(i = 0; i < mat.rows(); i++)
-    {
-        for(j = 0; j < mat.cols(); j++)
-        {
-            double sd = std::sqrt(2.0 / fan_in);
-            mat(i, j) = rnd->normal_distribution(0.0, sd);
-        }
-    }
+    double sd = std::sqrt(2.0 / fan_in);
+
+    rnd->fill_normal(mat.data(), mat.size(), 0.0, sd);
 }
 
 
@@ -134,7 +124,7 @@ Eigen::MatrixXd dql_square_loss(const Eigen::MatrixXd& output, const Eigen::Matr
 
 Eigen::MatrixXd dql_square_loss_with_error_clipping(const Eigen::MatrixXd& output, const Eigen::MatrixXd& target, int action_pos)
 {
-    double err_clip_val = 0.5; // keep positive
+    double err_clip_val = DQL_ERROR_CLIP_VALUE;
 
     Eigen::MatrixXd new_target = Eigen::MatrixXd::Zero(target.rows(), target.cols());
     new_target(0, action_pos) = target(0, action_pos);
@@ -176,6 +166,78 @@ Eigen::MatrixXd standard_loss(const Eigen::MatrixXd& output, const Eigen::Matrix
 }
 
 
+/* IN-PLACE LOSS FUNCTIONS */
+
+
+template<typename Scalar>
+void dql_square_loss_into(const mlp_matrix_t<Scalar>& output, const mlp_matrix_t<Scalar>& target, const std::vector<int>& action_pos, mlp_matrix_t<Scalar>& res)
+{
+    // target is only taken at the action position of each row
+    res = output.array().square().matrix();
+
+    int i;
+    for(i = 0; i < res.rows(); i++)
+    {
+        Scalar err = output(i, action_pos[i]) - target(i, action_pos[i]);
+        res(i, action_pos[i]) = err * err;
+    }
+}
+
+
+template<typename Scalar>
+void dql_square_loss_with_error_clipping_into(const mlp_matrix_t<Scalar>& output, const mlp_matrix_t<Scalar>& target, const std::vector<int>& action_pos, mlp_matrix_t<Scalar>& res)
+{
+    Scalar err_clip_val = DQL_ERROR_CLIP_VALUE;
+
+    res = output.array().square().matrix();
+
+    int i;
+    for(i = 0; i < res.rows(); i++)
+    {
+        // error clipping in interval [-(err_clip_val), err_clip_val].
+        Scalar err = std::min(std::max(output(i, action_pos[i]) - target(i, action_pos[i]), -err_clip_val), err_clip_val);
+        res(i, action_pos[i]) = err * err;
+    }
+}
+
+
+template<typename Scalar>
+void huber_loss_into(const mlp_matrix_t<Scalar>& output, const mlp_matrix_t<Scalar>& target, const std::vector<int>& action_pos, mlp_matrix_t<Scalar>& res)
+{
+    Scalar huber_delta = 1; // clipping between -1 and 1
+
+    res.setZero(target.rows(), target.cols());
+
+    int i;
+    for(i = 0; i < res.rows(); i++)
+    {
+        Scalar err = std::fabs(output(i, action_pos[i]) - target(i, action_pos[i]));
+
+        if(err <= huber_delta)
+            res(i, action_pos[i]) = Scalar(0.5) * (err * err);
+        else
+            res(i, action_pos[i]) = huber_delta * (err - (Scalar(0.5) * huber_delta));
+    }
+}
+
+
+template<typename Scalar>
+void standard_loss_into(const mlp_matrix_t<Scalar>& output, const mlp_matrix_t<Scalar>& target, const std::vector<int>& action_pos, mlp_matrix_t<Scalar>& res)
+{
+    res = output - target;
+}
+
+
+#define INSTANTIATE_LOSS_INTO(func) \
+    template void func<float>(const mlp_matrix_t<float>&, const mlp_matrix_t<float>&, const std::vector<int>&, mlp_matrix_t<float>&); \
+    template void func<double>(const mlp_matrix_t<double>&, const mlp_matrix_t<double>&, const std::vector<int>&, mlp_matrix_t<double>&);
+
+INSTANTIATE_LOSS_INTO(dql_square_loss_into)
+INSTANTIATE_LOSS_INTO(dql_square_loss_with_error_clipping_into)
+INSTANTIATE_LOSS_INTO(huber_loss_into)
+INSTANTIATE_LOSS_INTO(standard_loss_into)
+
+
 /* SCALING FUNCTIONS */
 
 
@@ -1,9 +1,95 @@
 
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
 #include "mlp-cpp/network.h"
 
 /* LAYER CLASS IMPLEMENTATION */
 
-Layer::Layer
+
+/* map the mlp_activation_func_t API onto the fused kernels in funcs.h and back */
+
+static mlp_activation_t find_activation_type(const mlp_activation_func_t& f)
+{
+    typedef Eigen::MatrixXd (*func_ptr_t)(const Eigen::MatrixXd&, bool);
+
+    const func_ptr_t* ptr = f.target<func_ptr_t>();
+    if(ptr == NULL)
+        return MLP_ACTIVATION_CUSTOM;
+
+    if(*ptr == mlp_sigmoid)
+        return MLP_ACTIVATION_SIGMOID;
+    if(*ptr == mlp_ReLU)
+        return MLP_ACTIVATION_RELU;
+    if(*ptr == mlp_linear)
+        return MLP_ACTIVATION_LINEAR;
+
+    return MLP_ACTIVATION_CUSTOM;
+}
+
+
+static mlp_activation_func_t find_activation_function(mlp_activation_t type)
+{
+    switch(type)
+    {
+        case MLP_ACTIVATION_SIGMOID:
+            return mlp_sigmoid;
+        case MLP_ACTIVATION_RELU:
+            return mlp_ReLU;
+        case MLP_ACTIVATION_LINEAR:
+            return mlp_linear;
+        default:
+            return NULL;
+    }
+}
+
+
+template<typename Scalar>
+static mlp_loss_into_func_t<Scalar> find_loss_into(const mlp_loss_func_t& f)
+{
+    typedef Eigen::MatrixXd (*func_ptr_t)(const Eigen::MatrixXd&, const Eigen::MatrixXd&, int);
+
+    const func_ptr_t* ptr = f.target<func_ptr_t>();
+    if(ptr == NULL)
+        return NULL;
+
+    if(*ptr == dql_square_loss)
+        return dql_square_loss_into<Scalar>;
+    if(*ptr == dql_square_loss_with_error_clipping)
+        return dql_square_loss_with_error_clipping_into<Scalar>;
+    if(*ptr == huber_loss)
+        return huber_loss_into<Scalar>;
+    if(*ptr == standard_loss)
+        return standard_loss_into<Scalar>;
+
+    return NULL;
+}
+
+
+template<typename Scalar>
+static mlp_sparse_loss_func_t<Scalar> find_loss_sparse(const mlp_loss_func_t& f)
+{
+    typedef Eigen::MatrixXd (*func_ptr_t)(const Eigen::MatrixXd&, const Eigen::MatrixXd&, int);
+
+    const func_ptr_t* ptr = f.target<func_ptr_t>();
+    if(ptr == NULL)
+        return NULL;
+
+    // standard_loss has a gradient at every output so has no sparse form
+    if(*ptr == dql_square_loss)
+        return dql_square_loss_sparse<Scalar>;
+    if(*ptr == dql_square_loss_with_error_clipping)
+        return dql_square_loss_with_error_clipping_sparse<Scalar>;
+    if(*ptr == huber_loss)
+        return huber_loss_sparse<Scalar>;
+
+    return NULL;
+}
+
+
+template<typename Scalar>
+BasicLayer<Scalar>::BasicLayer
 (
     int num_neurons,
     int num_next_neurons,
@@ -12,115 +98,221 @@ Layer::Layer
     mlp_activation_func_t activation_function,
     rand_helper* rnd
 )
-: is_input(is_input), is_output(is_output), activation_function(activation_function)
+: BasicLayer(num_neurons, num_next_neurons, is_input, is_output, find_activation_type(activation_function), rnd)
+{
+    this->activation_function = activation_function;
+}
+
+
+template<typename Scalar>
+BasicLayer<Scalar>::BasicLayer
+(
+    int num_neurons,
+    int num_next_neurons,
+    bool is_input,
+    bool is_output,
+    mlp_activation_t activation_type,
+    rand_helper* rnd
+)
+: is_input(is_input), is_output(is_output), W(NULL, 0, 0), dW(NULL, 0, 0), M(NULL, 0, 0), V(NULL, 0, 0), activation_function(find_activation_function(activation_type)), activation_type(activation_type)
 {
     // input, hidden layers and output layers
-    Z = Eigen::MatrixXd::Zero(1, num_neurons);
+    Z = matrix_t::Zero(1, num_neurons);
 
-    // hidden layers and input layer
+    // hidden layers and input layer, the weights are placed in the network's slab
     if(!is_output)
-    {
-        W = Eigen::MatrixXd::Zero(num_neurons, num_next_neurons);
-    }
+        B = row_vector_t::Constant(num_next_neurons, DEFAULT_BIAS);
 
     // hidden layers and output layer
     if(!is_input)
     {
-        S = Eigen::MatrixXd::Zero(1, num_neurons);
-        G = Eigen::MatrixXd::Zero(1, num_neurons);
-        Fp = Eigen::MatrixXd::Zero(1, num_neurons);
+        S = matrix_t::Zero(1, num_neurons);
+        G = matrix_t::Zero(1, num_neurons);
+        Fp = matrix_t::Zero(1, num_neurons);
     }
 }
 
 
-Eigen::MatrixXd Layer::weighted_sum(double bias)
+template<typename Scalar>
+void BasicLayer<Scalar>::activate()
 {
-    if(!is_input)
-    {
-        // store deriv of activation func with layer input for later
-        Fp = activation_function(S, true);
+    if(is_input)
+        return;
+
+    activate(S, Z, Fp);
+}
+
 
-        // run layer input through activation function
-        Z = activation_function(S, false);
+template<typename Scalar>
+void BasicLayer<Scalar>::activate(const matrix_t& S, matrix_t& Z, matrix_t& Fp) const
+{
+    // workspace only reallocates when the minibatch size changes
+    if(activation_type != MLP_ACTIVATION_CUSTOM)
+    {
+        // run layer input through activation function and store its deriv for later in one kernel
+        mlp_activate(activation_type, S, Z, Fp);
+        return;
     }
 
-    // not weighted sum if output layer - we just want to compute the above values
-    if(is_output)
-        return Z;
+    // custom activation functions work in double
+    Fp = activation_function(S.template cast<double>(), true).template cast<Scalar>();
+    Z = activation_function(S.template cast<double>(), false).template cast<Scalar>();
+}
+
+
+template<typename Scalar>
+void BasicLayer<Scalar>::weighted_sum(matrix_t& next_S) const
+{
+    next_S.noalias() = Z * W;
+    next_S.rowwise() += B;
+}
 
-    // computing bias matrices
-    Eigen::MatrixXd Z_bias = Z;
-    Z_bias.conservativeResize(Z_bias.rows(), Z_bias.cols()+1);
-    Z_bias.col(Z_bias.cols()-1) = Eigen::MatrixXd::Constant(1, 1, 1);
 
-    Eigen::MatrixXd W_bias = W;
-    W_bias.conservativeResize(W_bias.rows()+1, W_bias.cols());
-    W_bias.row(W_bias.rows()-1) = Eigen::MatrixXd::Constant(1, W_bias.cols(), bias);
+template<typename Scalar>
+void BasicLayer<Scalar>::activate_value(matrix_t& X) const
+{
+    if(activation_type != MLP_ACTIVATION_CUSTOM)
+    {
+        mlp_activate_value(activation_type, X);
+        return;
+    }
 
-    // weighted sum of inputs using computed bias matrices
-    return (Z_bias * W_bias);
+    // custom activation functions work in double
+    X = activation_function(X.template cast<double>(), false).template cast<Scalar>();
 }
 
 
 /* MLP CLASS IMPLEMENTATION */
 
 
-MLP::MLP
+template<typename Scalar>
+BasicMLP<Scalar>::BasicMLP
+(
+    const std::vector<int>& layer_config,
+    const std::pair<mlp_activation_t, mlp_activation_t>& type_pair,
+    weight_init_func_t initialiser,
+    mlp_loss_func_t loss_function,
+    rand_helper* rnd,
+    double learning_rate,
+    mlp_optimiser_t optimiser
+)
+: BasicMLP
+(
+    layer_config,
+    std::make_pair(find_activation_function(std::get<0>(type_pair)), find_activation_function(std::get<1>(type_pair))),
+    initialiser,
+    loss_function,
+    rnd,
+    learning_rate,
+    optimiser
+)
+{ }
+
+
+template<typename Scalar>
+BasicMLP<Scalar>::BasicMLP
 (
     const std::vector<int>& layer_config,
     const std::pair<mlp_activation_func_t, mlp_activation_func_t> & func_pair,
     weight_init_func_t initialiser,
     mlp_loss_func_t loss_function,
     rand_helper* rnd,
-    double learning_rate
+    double learning_rate,
+    mlp_optimiser_t optimiser
 )
-: loss_function(loss_function), learning_rate(learning_rate)
+: weight_slab(NULL), gradient_slab(NULL), M_slab(NULL), V_slab(NULL), loss_function(loss_function), learning_rate(learning_rate), beta1(DEFAULT_BETA1), beta2(DEFAULT_BETA2), optimiser_epsilon(DEFAULT_OPTIMISER_EPSILON), single_action_pos(1), pool(NULL), shard_rows(DEFAULT_SHARD_ROWS), sharded(false), sparse_output(false)
 {
+    loss_into = find_loss_into<Scalar>(loss_function);
+    loss_sparse = find_loss_sparse<Scalar>(loss_function);
+
+    this->layer_config = layer_config;
     num_layers = layer_config.size();
 
     // resizing layers vector
     layers.resize(num_layers);
 
     // setting output layer
-    layers[0] = new Layer(layer_config[0], layer_config[1], true, false, NULL, rnd);
+    layers[0] = new BasicLayer<Scalar>(layer_config[0], layer_config[1], true, false, NULL, rnd);
 
     // setting hidden layers
     int i;
     for(i = 1; i < (num_layers - 1); i++)
-        layers[i] = new Layer(layer_config[i], layer_config[i+1], false, false, std::get<0>(func_pair), rnd);
+        layers[i] = new BasicLayer<Scalar>(layer_config[i], layer_config[i+1], false, false, std::get<0>(func_pair), rnd);
 
     // setting output layer
-    layers[num_layers-1] = new Layer(layer_config[num_layers-1], 0, false, true, std::get<1>(func_pair), rnd);
+    layers[num_layers-1] = new BasicLayer<Scalar>(layer_config[num_layers-1], 0, false, true, std::get<1>(func_pair), rnd);
+
+    // slab layout, each weight matrix padded to a whole number of MLP_SLAB_ALIGNMENT blocks
+    std::size_t align_elems = MLP_SLAB_ALIGNMENT / sizeof(Scalar);
 
-    // initialising the weights
-    if(initialiser != NULL)
+    slab_offsets.resize(num_layers - 1);
+    slab_size = 0;
+    for(i = 0; i < (num_layers - 1); i++)
     {
-        for(i = 0; i < num_layers-1; i++)
+        slab_offsets[i] = slab_size;
+        slab_size += (((std::size_t)layer_config[i] * layer_config[i+1] + align_elems - 1) / align_elems) * align_elems;
+    }
+
+    resize_slab(weight_slab, true, &BasicLayer<Scalar>::W);
+
+    // initialising the weights, initialisers work in double
+    Eigen::MatrixXd init_W;
+    for(i = 0; i < num_layers-1; i++)
+    {
+        init_W = Eigen::MatrixXd::Zero(layers[i]->W.rows(), layers[i]->W.cols());
+
+        if(initialiser != NULL)
         {
             int fan_in = (i == 0) ? 1 : layers[i-1]->W.rows();
             int fan_out = layers[i]->W.cols();
-            initialiser(layers[i]->W, fan_in, fan_out, rnd);
+            initialiser(init_W, fan_in, fan_out, rnd);
         }
-    }
-    else // uniformally randomise the weights
-    {
-        int x, y;
-        for(i = 0; i < num_layers-1; i++)
+        else // uniformally randomise the weights
         {
-            for(x = 0; x < layers[i]->W.rows(); x++)
-            {
-                for(y = 0; y < layers[i]->W.cols(); y++)
-                    (layers[i]->W)(x, y) = rnd->random_double_range(-1.0, 1.0);
-            }
+            rnd->fill_double_range(init_W.data(), init_W.size(), -1.0, 1.0);
         }
+
+        layers[i]->W = init_W.cast<Scalar>();
     }
+
+    // size the optimiser state now the weights are known
+    set_optimiser(optimiser);
+}
+
+
+template<typename Scalar>
+BasicMLP<Scalar>::~BasicMLP()
+{
+    delete pool;
+
+    for(auto l : layers)
+        delete l;
+
+    std::free(weight_slab);
+    std::free(gradient_slab);
+    std::free(M_slab);
+    std::free(V_slab);
 }
 
 
-Eigen::MatrixXd MLP::forward_propogate(const std::vector<double>& input)
+template<typename Scalar>
+void BasicMLP<Scalar>::set_num_threads(int num_threads, int shard_rows)
 {
-    double bias = 1.0; // todo make dynamic
+    delete pool;
+    pool = (num_threads > 0) ? new ThreadPool(num_threads) : NULL;
+
+    this->shard_rows = (shard_rows > 0) ? shard_rows : DEFAULT_SHARD_ROWS;
+    shards.clear();
+    sharded = false;
 
+    // shards always reduce into dW
+    resize_slab(gradient_slab, (optimiser != MLP_OPTIMISER_SGD) || (pool != NULL), &BasicLayer<Scalar>::dW);
+}
+
+
+template<typename Scalar>
+const typename BasicMLP<Scalar>::matrix_t& BasicMLP<Scalar>::forward_propogate(const std::vector<double>& input)
+{
     // ensure input and first layer are of same dimension
     int n = layers[0]->Z.cols();
     if(n != input.size())
@@ -129,53 +321,657 @@ Eigen::MatrixXd MLP::forward_propogate(const std::vector<double>& input)
         std::exit(-1);
     }
 
-    // set Z in the input layer - no activation function
+    // set Z in the input layer - no activation function, a single sample is a minibatch of one row
+    layers[0]->Z.resize(1, n);
+
     int i;
     for(i = 0; i < n; i++)
         (layers[0]->Z)(0, i) = input[i];
 
+    return propogate_input();
+}
+
+
+template<typename Scalar>
+const typename BasicMLP<Scalar>::matrix_t& BasicMLP<Scalar>::forward_propogate(const matrix_t& input)
+{
+    // ensure input and first layer are of same dimension
+    int n = layers[0]->Z.cols();
+    if(n != input.cols())
+    {
+        std::cerr << "Data input to network is not of correct size, or network layout has been set incorrectly, exiting!\n";
+        std::exit(-1);
+    }
+
+    // an empty minibatch has no gradient to average, and would leave no shard to reduce
+    if(input.rows() == 0)
+    {
+        std::cerr << "Empty minibatch input to network, exiting!\n";
+        std::exit(-1);
+    }
+
+    // a minibatch that fits in one shard is not worth dispatching to the pool
+    if((pool != NULL) && (input.rows() > shard_rows))
+        return forward_sharded(input);
+
+    // set Z in the input layer - no activation function
+    layers[0]->Z = input;
+
+    return propogate_input();
+}
+
+
+template<typename Scalar>
+const typename BasicMLP<Scalar>::matrix_t& BasicMLP<Scalar>::propogate_input()
+{
+    sharded = false;
+
     // work out the input to the remaining layers as the weighted sum of the ouptut of previous layer
-    for(i = 1; i < layers.size(); i++)
+    int i;
+    for(i = 1; i < num_layers; i++)
     {
-        layers[i]->S = layers[i-1]->weighted_sum(bias);
+        layers[i-1]->weighted_sum(layers[i]->S);
+        layers[i]->activate();
     }
 
-    // compute Fp and Z for output using weighted_sum function, this returns early - does not compute a weighted sum.
-    return layers[num_layers-1]->weighted_sum(bias);
+    return layers[num_layers-1]->Z;
 }
 
 
-void MLP::back_propogate(const Eigen::MatrixXd& target)
+template<typename Scalar>
+const typename BasicMLP<Scalar>::matrix_t& BasicMLP<Scalar>::infer(const std::vector<double>& input, inference_scratch_t& scratch) const
 {
-    /* output layer */
-    layers[num_layers-1]->G = loss_function(layers[num_layers-1]->Z, target, 0); // action_pos not relevant
+    scratch.input.resize(1, input.size());
+
+    int i;
+    for(i = 0; i < input.size(); i++)
+        scratch.input(0, i) = input[i];
+
+    return infer(scratch.input, scratch);
+}
+
+
+template<typename Scalar>
+const typename BasicMLP<Scalar>::matrix_t& BasicMLP<Scalar>::infer(const matrix_t& input, inference_scratch_t& scratch) const
+{
+    // ensure input and first layer are of same dimension
+    if(layers[0]->W.rows() != input.cols())
+    {
+        std::cerr << "Data input to network is not of correct size, or network layout has been set incorrectly, exiting!\n";
+        std::exit(-1);
+    }
+
+    // alternate between the two scratch matrices, the network's own matrices are only read
+    const matrix_t* in = &input;
+    matrix_t* out = &scratch.A;
+    matrix_t* next_out = &scratch.B;
+
+    int i;
+    for(i = 1; i < num_layers; i++)
+    {
+        out->noalias() = (*in) * layers[i-1]->W;
+        out->rowwise() += layers[i-1]->B;
+        layers[i]->activate_value(*out);
+
+        in = out;
+        std::swap(out, next_out);
+    }
+
+    return *in;
+}
+
+
+template<typename Scalar>
+void BasicMLP<Scalar>::back_propogate(const matrix_t& target)
+{
+    sparse_output = false;
+
+    if(sharded)
+    {
+        for(auto& sh : shards)
+            sh.yj = target.middleRows(sh.row_start, sh.num_rows);
+
+        pool->parallel_for(shards.size(), [this](int s)
+        {
+            shard_t& sh = shards[s];
+            sh.G[num_layers-1] = loss_function(sh.Z[num_layers-1].template cast<double>(), sh.yj.template cast<double>(), 0).template cast<Scalar>();
+            back_propogate_shard(sh);
+        });
+
+        return;
+    }
+
+    /* output layer - action_pos not relevant, loss functions work in double */
+    layers[num_layers-1]->G = loss_function(layers[num_layers-1]->Z.template cast<double>(), target.template cast<double>(), 0).template cast<Scalar>();
 
     /* back propogating through remaining excluding input */
     int i;
     for(i = (num_layers-2); i > 0; i--)
-        layers[i]->G = (layers[i]->Fp.array().eval() * ((layers[i+1]->G * layers[i]->W.transpose().eval()).array().eval())).matrix();
+    {
+        layers[i]->G.noalias() = layers[i+1]->G * layers[i]->W.transpose();
+        layers[i]->G.array() *= layers[i]->Fp.array();
+    }
+}
+
+
+template<typename Scalar>
+void BasicMLP<Scalar>::back_propogate_rl(const matrix_t& yj, int action_pos)
+{
+    single_action_pos[0] = action_pos;
+    back_propogate_rl(yj, single_action_pos);
 }
 
 
-void MLP::back_propogate_rl(const Eigen::MatrixXd& yj, int action_pos)
+template<typename Scalar>
+void BasicMLP<Scalar>::back_propogate_rl(const matrix_t& yj, const std::vector<int>& action_pos)
 {
+    BasicLayer<Scalar>* out = layers[num_layers-1];
+
+    if((yj.rows() != out->Z.rows()) || (action_pos.size() != out->Z.rows()))
+    {
+        std::cerr << "Minibatch targets do not match the last forward propogation, exiting!\n";
+        std::exit(-1);
+    }
+
+    sparse_output = false;
+
+    int i;
+    if(sharded)
+    {
+        // targets are split before dispatch so each shard only touches its own buffers
+        for(auto& sh : shards)
+        {
+            sh.yj = yj.middleRows(sh.row_start, sh.num_rows);
+            sh.action_pos.assign(action_pos.begin() + sh.row_start, action_pos.begin() + sh.row_start + sh.num_rows);
+        }
+
+        pool->parallel_for(shards.size(), [this](int s)
+        {
+            shard_t& sh = shards[s];
+            matrix_t& out_G = sh.G[num_layers-1];
+
+            if(loss_into != NULL)
+            {
+                loss_into(sh.yj, sh.Z[num_layers-1], sh.action_pos, out_G);
+            }
+            else
+            {
+                out_G.resize(sh.num_rows, sh.Z[num_layers-1].cols());
+
+                int r;
+                for(r = 0; r < sh.num_rows; r++)
+                    out_G.row(r) = loss_function(sh.yj.row(r).template cast<double>(), sh.Z[num_layers-1].row(r).template cast<double>(), sh.action_pos[r]).template cast<Scalar>();
+            }
+
+            if(!sample_weights.empty())
+                out_G.array().colwise() *= Eigen::Map<const Eigen::Array<Scalar, Eigen::Dynamic, 1>>(sample_weights.data() + sh.row_start, sh.num_rows);
+
+            back_propogate_shard(sh);
+        });
+
+        sample_weights.clear();
+        return;
+    }
+
     /* output layer */
-    layers[num_layers-1]->G = loss_function(yj, layers[num_layers-1]->Z, action_pos);
+    if(loss_into != NULL)
+    {
+        loss_into(yj, out->Z, action_pos, out->G);
+    }
+    else
+    {
+        // custom loss functions work in double on a single row so apply per sample
+        out->G.resize(out->Z.rows(), out->Z.cols());
+        for(i = 0; i < out->Z.rows(); i++)
+            out->G.row(i) = loss_function(yj.row(i).template cast<double>(), out->Z.row(i).template cast<double>(), action_pos[i]).template cast<Scalar>();
+    }
+
+    if(!sample_weights.empty())
+    {
+        out->G.array().colwise() *= Eigen::Map<const Eigen::Array<Scalar, Eigen::Dynamic, 1>>(sample_weights.data(), sample_weights.size());
+        sample_weights.clear();
+    }
 
     /* back propogating through remaining excluding input */
-    int i;
     for(i = (num_layers-2); i > 0; i--)
-        layers[i]->G = layers[i]->Fp.array().eval() * (layers[i+1]->G * layers[i]->W.transpose().eval()).array().eval();
+    {
+        layers[i]->G.noalias() = layers[i+1]->G * layers[i]->W.transpose();
+        layers[i]->G.array() *= layers[i]->Fp.array();
+    }
 }
 
 
-void MLP::update_weights()
+template<typename Scalar>
+void BasicMLP<Scalar>::back_propogate_rl_sparse(const std::vector<double>& y, const std::vector<int>& action_pos)
 {
+    BasicLayer<Scalar>* out = layers[num_layers-1];
+    int rows = out->Z.rows();
+
+    if((y.size() != rows) || (action_pos.size() != rows))
+    {
+        std::cerr << "Minibatch targets do not match the last forward propogation, exiting!\n";
+        std::exit(-1);
+    }
+
     int i;
-    for(i = 0; i < (num_layers-1); i++)
+    if(loss_sparse == NULL)
     {
-        Eigen::MatrixXd W_diff = -(learning_rate) * (layers[i]->Z.transpose().eval() * layers[i+1]->G);
-        layers[i]->W += W_diff;
+        // no sparse form, build the dense targets
+        sparse_yj.setZero(rows, out->Z.cols());
+        for(i = 0; i < rows; i++)
+            sparse_yj(i, action_pos[i]) = y[i];
+
+        back_propogate_rl(sparse_yj, action_pos);
+        return;
+    }
+
+    /* output layer - one value per row, argument order follows back_propogate_rl */
+    sparse_G.resize(rows);
+    sparse_pos.assign(action_pos.begin(), action_pos.end());
+
+    for(i = 0; i < rows; i++)
+        sparse_G[i] = loss_sparse(Scalar(y[i]), out->Z(i, action_pos[i]));
+
+    if(!sample_weights.empty())
+    {
+        for(i = 0; i < rows; i++)
+            sparse_G[i] *= sample_weights[i];
+
+        sample_weights.clear();
+    }
+
+    sparse_output = true;
+
+    if(sharded)
+    {
+        pool->parallel_for(shards.size(), [this](int s) { back_propogate_shard(shards[s]); });
+        return;
+    }
+
+    /* last hidden layer - row i is column action_pos[i] of the last weights scaled by the row's gradient */
+    int last = num_layers - 2;
+    if(last > 0)
+    {
+        BasicLayer<Scalar>* l = layers[last];
+
+        l->G.resize(rows, l->W.rows());
+        for(i = 0; i < rows; i++)
+            l->G.row(i).noalias() = sparse_G[i] * l->W.col(action_pos[i]).transpose();
+
+        l->G.array() *= l->Fp.array();
+    }
+
+    /* back propogating through remaining excluding input */
+    for(i = (last-1); i > 0; i--)
+    {
+        layers[i]->G.noalias() = layers[i+1]->G * layers[i]->W.transpose();
+        layers[i]->G.array() *= layers[i]->Fp.array();
+    }
+}
+
+
+template<typename Scalar>
+void BasicMLP<Scalar>::back_propogate_rl_sparse(const std::vector<double>& y, const std::vector<int>& action_pos, const std::vector<double>& sample_weights)
+{
+    if(sample_weights.size() != y.size())
+    {
+        std::cerr << "Minibatch sample weights do not match the targets, exiting!\n";
+        std::exit(-1);
+    }
+
+    // consumed (and cleared) by the output layer of the back propogation
+    this->sample_weights.assign(sample_weights.begin(), sample_weights.end());
+
+    back_propogate_rl_sparse(y, action_pos);
+}
+
+
+template<typename Scalar>
+void BasicMLP<Scalar>::update_weights()
+{
+    optimiser_step++;
+
+    // a sparse output gradient leaves the last weights to sparse_gradient
+    int num_dense = sparse_output ? (num_layers-2) : (num_layers-1);
+
+    // average the gradient over the samples in the minibatch
+    int i;
+    if(sharded)
+    {
+        reduce_gradients(num_dense);
+    }
+    else if(optimiser == MLP_OPTIMISER_SGD)
+    {
+        // plain sgd needs no gradient workspace
+        Scalar step = learning_rate / layers[0]->Z.rows();
+
+        for(i = 0; i < num_dense; i++)
+            layers[i]->W.noalias() -= step * (layers[i]->Z.transpose() * layers[i+1]->G);
+    }
+    else
+    {
+        Scalar scale = Scalar(1) / layers[0]->Z.rows();
+
+        for(i = 0; i < num_dense; i++)
+            layers[i]->dW.noalias() = scale * (layers[i]->Z.transpose() * layers[i+1]->G);
+    }
+
+    if(sparse_output)
+        sparse_gradient();
+
+    if(optimiser != MLP_OPTIMISER_SGD)
+        apply_gradients(num_layers-1);
+    else if(sharded)
+        apply_gradients(num_dense);
+}
+
+
+template<typename Scalar>
+void BasicMLP<Scalar>::apply_gradients(int num_weights)
+{
+    Scalar lr = learning_rate;
+    Scalar b1 = beta1;
+    Scalar b2 = beta2;
+    Scalar eps = optimiser_epsilon;
+
+    // adam bias correction folded into the step size
+    if(optimiser == MLP_OPTIMISER_ADAM)
+        lr *= std::sqrt(1.0 - std::pow(beta2, (double)optimiser_step)) / (1.0 - std::pow(beta1, (double)optimiser_step));
+
+    int i;
+    for(i = 0; i < num_weights; i++)
+    {
+        BasicLayer<Scalar>* l = layers[i];
+
+        switch(optimiser)
+        {
+            case MLP_OPTIMISER_SGD:
+                l->W.noalias() -= lr * l->dW;
+                break;
+            case MLP_OPTIMISER_MOMENTUM:
+                l->M = (b1 * l->M) + l->dW;
+                l->W.noalias() -= lr * l->M;
+                break;
+            case MLP_OPTIMISER_RMSPROP:
+                l->V.array() = (b2 * l->V.array()) + ((1 - b2) * l->dW.array().square());
+                l->W.array() -= lr * l->dW.array() / (l->V.array().sqrt() + eps);
+                break;
+            case MLP_OPTIMISER_ADAM:
+                l->M.array() = (b1 * l->M.array()) + ((1 - b1) * l->dW.array());
+                l->V.array() = (b2 * l->V.array()) + ((1 - b2) * l->dW.array().square());
+                l->W.array() -= lr * l->M.array() / (l->V.array().sqrt() + eps);
+                break;
+        }
+    }
+}
+
+
+template<typename Scalar>
+void BasicMLP<Scalar>::sparse_gradient()
+{
+    BasicLayer<Scalar>* l = layers[num_layers-2];
+    Scalar scale = Scalar(1) / sparse_G.size();
+
+    // sgd steps straight into the used columns, adaptive optimisers need the full gradient for their state
+    param_map_t* dst = &(l->W);
+    if(optimiser == MLP_OPTIMISER_SGD)
+    {
+        scale *= -learning_rate;
+    }
+    else
+    {
+        l->dW.setZero();
+        dst = &(l->dW);
+    }
+
+    // rows are added in order so the result does not depend on sharding
+    int i, row;
+    for(i = 0; i < sparse_G.size(); i++)
+    {
+        const matrix_t& Z = last_hidden_Z(i, row);
+        dst->col(sparse_pos[i]).noalias() += (scale * sparse_G[i]) * Z.row(row).transpose();
+    }
+}
+
+
+template<typename Scalar>
+const typename BasicMLP<Scalar>::matrix_t& BasicMLP<Scalar>::last_hidden_Z(int i, int& row) const
+{
+    if(!sharded)
+    {
+        row = i;
+        return layers[num_layers-2]->Z;
+    }
+
+    // every shard but the last has shard_rows rows
+    row = i % shard_rows;
+    return shards[i / shard_rows].Z[num_layers-2];
+}
+
+
+/* DATA PARALLEL TRAINING */
+
+
+template<typename Scalar>
+const typename BasicMLP<Scalar>::matrix_t& BasicMLP<Scalar>::forward_sharded(const matrix_t& input)
+{
+    int rows = input.rows();
+    int num_shards = (rows + shard_rows - 1) / shard_rows;
+
+    // shard workspaces only reallocate when the minibatch size changes
+    if(shards.size() != num_shards)
+        shards.resize(num_shards);
+
+    int s;
+    for(s = 0; s < num_shards; s++)
+    {
+        shards[s].row_start = s * shard_rows;
+        shards[s].num_rows = std::min(shard_rows, rows - shards[s].row_start);
+
+        if(shards[s].Z.size() != num_layers)
+        {
+            shards[s].S.resize(num_layers);
+            shards[s].Z.resize(num_layers);
+            shards[s].Fp.resize(num_layers);
+            shards[s].G.resize(num_layers);
+            shards[s].dW.resize(num_layers - 1);
+        }
+    }
+
+    matrix_t& out = layers[num_layers-1]->Z;
+    out.resize(rows, out.cols());
+
+    pool->parallel_for(num_shards, [this, &input](int s)
+    {
+        shard_t& sh = shards[s];
+
+        sh.Z[0] = input.middleRows(sh.row_start, sh.num_rows);
+
+        int i;
+        for(i = 1; i < num_layers; i++)
+        {
+            sh.S[i].noalias() = sh.Z[i-1] * layers[i-1]->W;
+            sh.S[i].rowwise() += layers[i-1]->B;
+            layers[i]->activate(sh.S[i], sh.Z[i], sh.Fp[i]);
+        }
+
+        // shards own disjoint rows of the output
+        layers[num_layers-1]->Z.middleRows(sh.row_start, sh.num_rows) = sh.Z[num_layers-1];
+    });
+
+    sharded = true;
+
+    return out;
+}
+
+
+template<typename Scalar>
+void BasicMLP<Scalar>::back_propogate_shard(shard_t& shard)
+{
+    int last = num_layers - 2;
+    int i;
+
+    // sparse output gradient goes straight into the last hidden layer, see back_propogate_rl_sparse
+    int top = last;
+    if(sparse_output)
+    {
+        if(last > 0)
+        {
+            shard.G[last].resize(shard.num_rows, layers[last]->W.rows());
+            for(i = 0; i < shard.num_rows; i++)
+                shard.G[last].row(i).noalias() = sparse_G[shard.row_start + i] * layers[last]->W.col(sparse_pos[shard.row_start + i]).transpose();
+
+            shard.G[last].array() *= shard.Fp[last].array();
+        }
+
+        top = last - 1;
+    }
+
+    for(i = top; i > 0; i--)
+    {
+        shard.G[i].noalias() = shard.G[i+1] * layers[i]->W.transpose();
+        shard.G[i].array() *= shard.Fp[i].array();
+    }
+
+    // the last weights' gradient is left to sparse_gradient for a sparse output
+    int num_dense = sparse_output ? last : (last + 1);
+    for(i = 0; i < num_dense; i++)
+        shard.dW[i].noalias() = shard.Z[i].transpose() * shard.G[i+1];
+}
+
+
+template<typename Scalar>
+void BasicMLP<Scalar>::reduce_gradients(int num_weights)
+{
+    // one task per layer, each sums the shards in order so the result is independent of the thread count
+    pool->parallel_for(num_weights, [this](int i)
+    {
+        param_map_t& dW = layers[i]->dW;
+
+        dW = shards[0].dW[i];
+
+        int s;
+        for(s = 1; s < shards.size(); s++)
+            dW += shards[s].dW[i];
+
+        dW *= Scalar(1) / layers[num_layers-1]->Z.rows();
+    });
+}
+
+
+template<typename Scalar>
+void BasicMLP<Scalar>::set_optimiser(mlp_optimiser_t optimiser)
+{
+    this->optimiser = optimiser;
+    optimiser_step = 0;
+
+    // unused state is freed, serial sgd steps the weights without a gradient workspace
+    resize_slab(gradient_slab, (optimiser != MLP_OPTIMISER_SGD) || (pool != NULL), &BasicLayer<Scalar>::dW);
+    resize_slab(M_slab, optimiser_uses_M(optimiser), &BasicLayer<Scalar>::M);
+    resize_slab(V_slab, optimiser_uses_V(optimiser), &BasicLayer<Scalar>::V);
+
+    // state kept from a previous optimiser starts again from zero
+    for(Scalar* slab : {gradient_slab, M_slab, V_slab})
+        if(slab != NULL)
+            std::memset(slab, 0, slab_size * sizeof(Scalar));
+}
+
+
+template<typename Scalar>
+void BasicMLP<Scalar>::resize_slab(Scalar*& slab, bool used, param_map_t BasicLayer<Scalar>::* tensor)
+{
+    if(used && (slab == NULL))
+    {
+        // slab_size is a whole number of alignment blocks as aligned_alloc requires
+        slab = (Scalar*)std::aligned_alloc(MLP_SLAB_ALIGNMENT, slab_size * sizeof(Scalar));
+        if(slab == NULL)
+        {
+            std::cerr << "Could not allocate network parameters, exiting!\n";
+            std::exit(-1);
+        }
+
+        std::memset(slab, 0, slab_size * sizeof(Scalar));
+    }
+    else if(!used)
+    {
+        std::free(slab);
+        slab = NULL;
+    }
+
+    // re-seat the views, Eigen::Map has no other way of changing its data
+    int i;
+    for(i = 0; i < (num_layers - 1); i++)
+    {
+        BasicLayer<Scalar>* l = layers[i];
+
+        if(slab != NULL)
+            new (&(l->*tensor)) param_map_t(slab + slab_offsets[i], layer_config[i], layer_config[i+1]);
+        else
+            new (&(l->*tensor)) param_map_t(NULL, 0, 0);
+    }
+}
+
+
+/* WHOLE NETWORK PARAMETER OPERATIONS */
+
+
+template<typename Scalar>
+template<typename OtherScalar>
+void BasicMLP<Scalar>::check_same_layout(const BasicMLP<OtherScalar>* net) const
+{
+    bool same = (net->num_layers == num_layers);
+
+    int i;
+    for(i = 0; same && (i < (num_layers - 1)); i++)
+        same = (net->layers[i]->W.rows() == layers[i]->W.rows()) && (net->layers[i]->W.cols() == layers[i]->W.cols());
+
+    if(!same)
+    {
+        std::cerr << "Networks do not have the same layer config, cannot copy weights, exiting!\n";
+        std::exit(-1);
+    }
+}
+
+
+template<typename Scalar>
+template<typename OtherScalar>
+void BasicMLP<Scalar>::copy_weights_from(const BasicMLP<OtherScalar>* net)
+{
+    check_same_layout(net);
+
+    // padding is zero in both slabs so it can be copied along with the weights
+    if constexpr(std::is_same<Scalar, OtherScalar>::value)
+    {
+        std::memcpy(weight_slab, net->weight_slab, slab_size * sizeof(Scalar));
+    }
+    else
+    {
+        // padding differs between precisions so convert layer by layer
+        int i;
+        for(i = 0; i < (num_layers - 1); i++)
+            layers[i]->W = net->layers[i]->W.template cast<Scalar>();
+    }
+}
+
+
+template<typename Scalar>
+template<typename OtherScalar>
+void BasicMLP<Scalar>::soft_update_from(const BasicMLP<OtherScalar>* net, double tau)
+{
+    check_same_layout(net);
+
+    if constexpr(std::is_same<Scalar, OtherScalar>::value)
+    {
+        Eigen::Map<Eigen::Array<Scalar, Eigen::Dynamic, 1>> W(weight_slab, slab_size);
+        Eigen::Map<const Eigen::Array<Scalar, Eigen::Dynamic, 1>> W_net(net->weight_slab, net->slab_size);
+
+        W = (Scalar(1 - tau) * W) + (Scalar(tau) * W_net);
+    }
+    else
+    {
+        int i;
+        for(i = 0; i < (num_layers - 1); i++)
+            layers[i]->W = (Scalar(1 - tau) * layers[i]->W) + (Scalar(tau) * net->layers[i]->W.template cast<Scalar>());
     }
 }
 
@@ -183,7 +979,8 @@ void MLP::update_weights()
 /* LOADING AND SAVING WEIGHTS */
 
 
-void save_weights(const MLP* net, const std::string& filename)
+template<typename Scalar>
+void save_weights(const BasicMLP<Scalar>* net, const std::string& filename)
 {
     std::ofstream output_file(filename.c_str());
 
@@ -208,7 +1005,8 @@ void save_weights(const MLP* net, const std::string& filename)
 }
 
 
-void load_weights(MLP* net, const std::string& filename)
+template<typename Scalar>
+void load_weights(BasicMLP<Scalar>* net, const std::string& filename)
 {
     std::ifstream input_file(filename.c_str());
 
@@ -250,4 +1048,30 @@ void load_weights(MLP* net, const std::string& filename)
     input_file.close();
 
     return;
-}
\ No newline at end of file
+}
+
+
+/* EXPLICIT INSTANTIATIONS */
+
+
+template class BasicLayer<float>;
+template class BasicLayer<double>;
+
+template class BasicMLP<float>;
+template class BasicMLP<double>;
+
+template void BasicMLP<float>::copy_weights_from<float>(const BasicMLP<float>* net);
+template void BasicMLP<float>::copy_weights_from<double>(const BasicMLP<double>* net);
+template void BasicMLP<double>::copy_weights_from<float>(const BasicMLP<float>* net);
+template void BasicMLP<double>::copy_weights_from<double>(const BasicMLP<double>* net);
+
+template void BasicMLP<float>::soft_update_from<float>(const BasicMLP<float>* net, double tau);
+template void BasicMLP<float>::soft_update_from<double>(const BasicMLP<double>* net, double tau);
+template void BasicMLP<double>::soft_update_from<float>(const BasicMLP<float>* net, double tau);
+template void BasicMLP<double>::soft_update_from<double>(const BasicMLP<double>* net, double tau);
+
+template void save_weights<float>(const BasicMLP<float>* net, const std::string& filename);
+template void save_weights<double>(const BasicMLP<double>* net, const std::string& filename);
+
+template void load_weights<float>(BasicMLP<float>* net, const std::string& filename);
+template void load_weights<double>(BasicMLP<double>* net, const std::string& filename);
@@ -0,0 +1,172 @@
+
+#include <cmath>
+
+#include "mlp-cpp/quantized_network.h"
+
+
+/* HELPERS */
+
+
+/* symmetric scale mapping the largest magnitude onto QUANTIZED_MAX, all zero data gets a scale of one */
+static float quantization_scale(float max_abs)
+{
+    return (max_abs > 0) ? (max_abs / QUANTIZED_MAX) : 1.0f;
+}
+
+
+static int8_t quantize_value(float v, float inv_scale)
+{
+    // round half away from zero then clamp
+    float r = v * inv_scale;
+    r += (r >= 0) ? 0.5f : -0.5f;
+
+    return (int8_t)std::min(std::max(r, (float)-QUANTIZED_MAX), (float)QUANTIZED_MAX);
+}
+
+
+/* acc += x * w over num_blocks blocks of QUANTIZED_BLOCK, the fixed inner trip count lets the compiler vectorise */
+static void axpy_int8(int32_t x, const int8_t* __restrict w, int32_t* __restrict acc, int num_blocks)
+{
+    int b, j;
+    for(b = 0; b < num_blocks; b++)
+    {
+        for(j = 0; j < QUANTIZED_BLOCK; j++)
+            acc[j] += x * (int32_t)w[j];
+
+        w += QUANTIZED_BLOCK;
+        acc += QUANTIZED_BLOCK;
+    }
+}
+
+
+/* QUANTIZED MLP */
+
+
+template<typename Scalar>
+QuantizedMLP::QuantizedMLP(const BasicMLP<Scalar>* net)
+: num_layers(net->num_layers)
+{
+    layers.resize(num_layers - 1);
+
+    int i;
+    for(i = 0; i < (num_layers - 1); i++)
+    {
+        QuantizedLayer& q = layers[i];
+        Eigen::MatrixXf W = net->layers[i]->W.template cast<float>();
+
+        q.num_outputs = W.cols();
+        q.scale = quantization_scale(W.cwiseAbs().maxCoeff());
+
+        int padded = ((W.cols() + QUANTIZED_BLOCK - 1) / QUANTIZED_BLOCK) * QUANTIZED_BLOCK;
+        q.W = qmatrix_t::Zero(W.rows(), padded);
+        q.W.leftCols(W.cols()) = W.unaryExpr([&q](float v) { return quantize_value(v, 1.0f / q.scale); });
+
+        q.B = net->layers[i]->B.template cast<float>();
+
+        q.activation_type = net->layers[i+1]->activation_type;
+        q.activation_function = net->layers[i+1]->activation_function;
+    }
+}
+
+
+const QuantizedMLP::matrix_t& QuantizedMLP::infer(const std::vector<double>& input, inference_scratch_t& scratch) const
+{
+    if(input.size() != get_num_features())
+    {
+        std::cerr << "Data input to network is not of correct size, or network layout has been set incorrectly, exiting!\n";
+        std::exit(-1);
+    }
+
+    scratch.Z.resize(num_layers);
+
+    matrix_t& in = scratch.Z[0];
+    in.resize(1, input.size());
+
+    int i, j;
+    for(i = 0; i < input.size(); i++)
+        in(0, i) = input[i];
+
+    for(i = 0; i < layers.size(); i++)
+    {
+        const QuantizedLayer& q = layers[i];
+        const matrix_t& A = scratch.Z[i];
+        matrix_t& out = scratch.Z[i+1];
+
+        // quantize this layer's input with its own scale
+        float in_scale = quantization_scale(A.cwiseAbs().maxCoeff());
+        float inv_in_scale = 1.0f / in_scale;
+
+        scratch.input_q.resize(A.cols());
+        for(j = 0; j < A.cols(); j++)
+            scratch.input_q[j] = quantize_value(A(0, j), inv_in_scale);
+
+        // int32 accumulate over the inputs, zero inputs (e.g. after ReLU) are skipped
+        int num_blocks = q.W.cols() / QUANTIZED_BLOCK;
+
+        scratch.acc.assign(q.W.cols(), 0);
+        for(j = 0; j < A.cols(); j++)
+        {
+            if(scratch.input_q[j] != 0)
+                axpy_int8(scratch.input_q[j], q.W.row(j).data(), scratch.acc.data(), num_blocks);
+        }
+
+        // dequantize with both scales
+        float out_scale = in_scale * q.scale;
+
+        out.resize(1, q.num_outputs);
+        for(j = 0; j < q.num_outputs; j++)
+            out(0, j) = (scratch.acc[j] * out_scale) + q.B(j);
+
+        if(q.activation_type != MLP_ACTIVATION_CUSTOM)
+            mlp_activate_value(q.activation_type, out);
+        else
+            out = q.activation_function(out.cast<double>(), false).cast<float>();
+    }
+
+    return scratch.Z[num_layers-1];
+}
+
+
+/* AGREEMENT REPORT */
+
+
+template<typename Scalar>
+quantization_report_t compare_quantized(const BasicMLP<Scalar>* net, const QuantizedMLP* qnet, const std::vector<std::vector<double>>& states)
+{
+    quantization_report_t report = {0, 0, 0.0, 0.0};
+
+    typename BasicMLP<Scalar>::inference_scratch_t scratch;
+    QuantizedMLP::inference_scratch_t q_scratch;
+
+    for(auto const& st : states)
+    {
+        Eigen::MatrixXd vals = net->infer(st, scratch).template cast<double>();
+        Eigen::MatrixXd q_vals = qnet->infer(st, q_scratch).cast<double>();
+
+        Eigen::Index best, q_best;
+        vals.row(0).maxCoeff(&best);
+        q_vals.row(0).maxCoeff(&q_best);
+
+        double err = (vals - q_vals).cwiseAbs().maxCoeff();
+
+        report.num_states++;
+        report.argmax_agreement += (best == q_best);
+        report.max_abs_error = std::max(report.max_abs_error, err);
+        report.mean_abs_error += (vals - q_vals).cwiseAbs().sum() / vals.size();
+    }
+
+    if(report.num_states > 0)
+        report.mean_abs_error /= report.num_states;
+
+    return report;
+}
+
+
+/* EXPLICIT INSTANTIATIONS */
+
+
+template QuantizedMLP::QuantizedMLP<float>(const BasicMLP<float>* net);
+template QuantizedMLP::QuantizedMLP<double>(const BasicMLP<double>* net);
+
+template quantization_report_t compare_quantized<float>(const BasicMLP<float>* net, const QuantizedMLP* qnet, const std::vector<std::vector<double>>& states);
+template quantization_report_t compare_quantized<double>(const BasicMLP<double>* net, const QuantizedMLP* qnet, const std::vector<std::vector<double>>& states);
@@ -0,0 +1,87 @@
+
+#include "mlp-cpp/thread_pool.h"
+
+
+ThreadPool::ThreadPool(int num_threads)
+: task(NULL), num_tasks(0), next_task(0), active(0), generation(0), stopping(false)
+{
+    int i;
+    for(i = 1; i < num_threads; i++)
+        workers.emplace_back(&ThreadPool::run, this);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    start_cv.notify_all();
+
+    for(auto& w : workers)
+        w.join();
+}
+
+
+void ThreadPool::parallel_for(int num_tasks, const std::function<void(int)>& task)
+{
+    if(workers.empty() || (num_tasks <= 1))
+    {
+        int i;
+        for(i = 0; i < num_tasks; i++)
+            task(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        this->task = &task;
+        this->num_tasks = num_tasks;
+        next_task = 0;
+        active = workers.size();
+        generation++;
+    }
+    start_cv.notify_all();
+
+    // calling thread works alongside the pool
+    work();
+
+    std::unique_lock<std::mutex> lock(mtx);
+    done_cv.wait(lock, [this]() { return active == 0; });
+
+    this->task = NULL;
+}
+
+
+void ThreadPool::work()
+{
+    int i;
+    while((i = next_task.fetch_add(1)) < num_tasks)
+        (*task)(i);
+}
+
+
+void ThreadPool::run()
+{
+    unsigned long seen = 0;
+
+    std::unique_lock<std::mutex> lock(mtx);
+
+    while(true)
+    {
+        start_cv.wait(lock, [this, &seen]() { return stopping || (generation != seen); });
+
+        if(stopping)
+            break;
+
+        seen = generation;
+
+        lock.unlock();
+        work();
+        lock.lock();
+
+        if(--active == 0)
+            done_cv.notify_all();
+    }
+}
@@ -14,7 +14,7 @@
 #include "non-ml/non-ml.h"
 
 
-std::vector<std::string> random_optimiser(const std::string& program_name, const std::vector<std::string>& action_space, const std::string& baseline, int iterations, rand_helper* rnd_helper)
+std::vector<std::string> random_optimiser(const std::string& program_name, const std::vector<std::string>& action_space, const std::string& baseline, int iterations, rand_helper* rnd_helper, EvalCache* eval_cache)
 {
     std::vector<std::string> ret;
     double best_runtime = std::numeric_limits<double>::max();
@@ -35,7 +35,8 @@ std::vector<std::string> random_optimiser(const std::string& program_name, const
         std::cout << "Optimisations chosen: " << opt_string << '\n';
 
         // get runtime
-        double curr_runtime = run_given_string((format_benchmark_string(program_name) + " " + baseline + " " + opt_string), program_name);
+        std::string compile_string(format_benchmark_string(program_name) + " " + baseline + " " + opt_string + " " + get_polybench_object(baseline));
+        double curr_runtime = (eval_cache != NULL) ? eval_cache->get_runtime(compile_string, program_name, baseline, shuffle_res) : run_given_string(compile_string, program_name);
 
         std::cout << "Best so far: ";
 
@@ -51,5 +52,9 @@ std::vector<std::string> random_optimiser(const std::string& program_name, const
     }
 
     std::cout << "BEST RUNTIME: " << best_runtime << "\n";
+
+    if(eval_cache != NULL)
+        eval_cache->print_stats();
+
     return ret;
 }
\ No newline at end of file
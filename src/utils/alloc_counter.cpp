@@ -0,0 +1,105 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 18/06/2024
+ * FILE LAST UPDATED: 18/06/2024
+ *
+ * REQUIREMENTS: GNU ld (--wrap)
+ * REFERENCES:
+ *
+ * DESCRIPTION: Implementation file for the heap allocation counter.
+*/
+
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <atomic>
+
+#include "utils/alloc_counter.h"
+
+
+static std::atomic<unsigned long> num_allocations(0);
+
+
+/* LINK TIME WRAPPERS - the linker sends every malloc etc. in the program here, __real_* are the libc functions */
+
+extern "C"
+{
+    void* __real_malloc(std::size_t size);
+    void* __real_calloc(std::size_t num, std::size_t size);
+    void* __real_realloc(void* p, std::size_t size);
+    void __real_free(void* p);
+    int __real_posix_memalign(void** p, std::size_t alignment, std::size_t size);
+    void* __real_aligned_alloc(std::size_t alignment, std::size_t size);
+
+    void* __wrap_malloc(std::size_t size)
+    {
+        num_allocations.fetch_add(1, std::memory_order_relaxed);
+        return __real_malloc(size);
+    }
+
+    void* __wrap_calloc(std::size_t num, std::size_t size)
+    {
+        num_allocations.fetch_add(1, std::memory_order_relaxed);
+        return __real_calloc(num, size);
+    }
+
+    void* __wrap_realloc(void* p, std::size_t size)
+    {
+        // growing a block may move it, but only realloc of NULL is a new allocation
+        if(p == NULL)
+            num_allocations.fetch_add(1, std::memory_order_relaxed);
+
+        return __real_realloc(p, size);
+    }
+
+    void __wrap_free(void* p)
+    {
+        __real_free(p);
+    }
+
+    int __wrap_posix_memalign(void** p, std::size_t alignment, std::size_t size)
+    {
+        num_allocations.fetch_add(1, std::memory_order_relaxed);
+        return __real_posix_memalign(p, alignment, size);
+    }
+
+    void* __wrap_aligned_alloc(std::size_t alignment, std::size_t size)
+    {
+        num_allocations.fetch_add(1, std::memory_order_relaxed);
+        return __real_aligned_alloc(alignment, size);
+    }
+}
+
+
+/* OPERATOR NEW - libstdc++'s operator new calls malloc from inside the shared library, where it is not wrapped */
+
+void* operator new(std::size_t size)
+{
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void* p = __real_malloc(size ? size : 1);
+    if(p == NULL)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept { __real_free(p); }
+
+void operator delete[](void* p) noexcept { __real_free(p); }
+
+void operator delete(void* p, std::size_t size) noexcept { __real_free(p); }
+
+void operator delete[](void* p, std::size_t size) noexcept { __real_free(p); }
+
+
+unsigned long get_num_allocations()
+{
+    return num_allocations.load(std::memory_order_relaxed);
+}
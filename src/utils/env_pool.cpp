@@ -0,0 +1,96 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 12/06/2024
+ * FILE LAST UPDATED: 12/06/2024
+ *
+ * REQUIREMENTS: PolyBench
+ * REFERENCES:
+ *
+ * DESCRIPTION: Implementation file for the concurrent PolyBench environment pool.
+*/
+
+#include <iostream>
+#include <filesystem>
+
+#include "utils/env_pool.h"
+#include "mlp-cpp/funcs.h"
+
+
+EnvironmentPool::EnvironmentPool(const int num_envs, const std::string& program_name, const std::string& baseline)
+{
+    if(num_envs < 1)
+    {
+        std::cerr << "Environment pool needs at least one environment, exiting!\n";
+        std::exit(-1);
+    }
+
+    int i;
+    for(i = 0; i < num_envs; i++)
+    {
+        std::string scratch_dir = DEFAULT_SCRATCH_LOCATION + std::to_string(i) + "/";
+
+        std::error_code ec;
+        std::filesystem::create_directories(scratch_dir, ec);
+        if(ec)
+        {
+            std::cerr << "ERROR CREATING ENVIRONMENT SCRATCH FOLDER: " << scratch_dir << ", exiting!\n";
+            std::exit(-1);
+        }
+
+        scratch_dirs.push_back(scratch_dir);
+        envs.push_back(construct_polybench_PolyString(program_name, baseline, scratch_dir));
+    }
+
+    // environments spend their time waiting on child processes so one thread each, not one per core
+    workers = new ThreadPool(num_envs);
+
+    return;
+}
+
+
+EnvironmentPool::~EnvironmentPool()
+{
+    delete workers;
+
+    for(auto env : envs)
+        delete env;
+
+    // scratch folders are left empty by every step, remove them with the pool
+    std::error_code ec;
+    for(auto const& dir : scratch_dirs)
+        std::filesystem::remove_all(dir, ec);
+}
+
+
+void EnvironmentPool::for_each_env(const int num_envs, const std::function<void(int)>& task)
+{
+    workers->parallel_for(num_envs, task);
+}
+
+
+void EnvironmentPool::get_states(const int num_envs, const int num_features, std::vector<std::vector<double>>& states, FeatureCache* feature_cache)
+{
+    states.resize(num_envs);
+
+    for_each_env(num_envs, [&](int i) {
+        states[i] = vec_min_max_scaling((feature_cache != NULL) ? feature_cache->get_program_state(envs[i], num_features) : get_program_state(envs[i], num_features));
+    });
+}
+
+
+void EnvironmentPool::get_runtimes(const int num_envs, bool unoptimised, std::vector<double>& runtimes, EvalCache* eval_cache)
+{
+    runtimes.resize(num_envs);
+
+    for_each_env(num_envs, [&](int i) {
+        if(eval_cache != NULL)
+        {
+            runtimes[i] = eval_cache->get_runtime(envs[i], unoptimised);
+            return;
+        }
+
+        std::string compile_string = unoptimised ? envs[i]->get_no_plugin_no_optimisations_PolyString() : envs[i]->get_no_plugin_PolyString();
+        runtimes[i] = run_given_string(compile_string, envs[i]->program_name, envs[i]->exec_location);
+    });
+}
@@ -0,0 +1,175 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 14/06/2024
+ * FILE LAST UPDATED: 14/06/2024
+ *
+ * REQUIREMENTS: PolyBench
+ * REFERENCES:
+ *
+ * DESCRIPTION: Implementation file for the persistent runtime cache.
+*/
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+
+#include "utils/eval_cache.h"
+
+
+EvalCache::EvalCache(const std::string& filename, const unsigned int min_samples)
+:
+    filename(filename),
+    min_samples((min_samples > 0) ? min_samples : 1),
+    hits(0),
+    misses(0),
+    num_loaded(0)
+{
+    if(filename.empty())
+        return;
+
+    load();
+
+    out_file.open(filename, std::ios::app);
+    if(!out_file.is_open())
+        std::cerr << "ERROR OPENING EVALUATION CACHE, RUNTIMES WILL NOT BE SAVED: " << filename << '\n';
+
+    // runtimes read back exactly as they were measured
+    out_file.precision(17);
+
+    return;
+}
+
+
+void EvalCache::load()
+{
+    std::ifstream in_file(filename);
+
+    // a cache that does not exist yet is created on the first sample
+    if(!in_file.is_open())
+        return;
+
+    std::string line;
+    while(getline(in_file, line))
+    {
+        std::size_t sep = line.rfind('\t');
+        if((sep == std::string::npos) || (std::count(line.begin(), line.end(), '\t') != 5))
+            continue;
+
+        char* end;
+        double runtime = std::strtod(line.c_str() + sep + 1, &end);
+        if((end == (line.c_str() + sep + 1)) || (*end != '\0'))
+            continue;
+
+        samples[line.substr(0, sep)].push_back(runtime);
+        num_loaded++;
+    }
+
+    return;
+}
+
+
+std::string EvalCache::canonical_flags(const std::vector<std::string>& flags, std::string& dataset)
+{
+    std::vector<std::string> sorted;
+    dataset = DEFAULT_DATASET_SIZE;
+
+    for(auto const& flag : flags)
+    {
+        if(flag.empty())
+            continue;
+
+        if((flag.compare(0, 2, "-D") == 0) && (flag.size() > 10) && (flag.compare(flag.size() - 8, 8, "_DATASET") == 0))
+        {
+            dataset = flag.substr(2);
+            continue;
+        }
+
+        sorted.push_back(flag);
+    }
+
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    std::string res;
+    for(auto const& flag : sorted)
+        res += (res.empty() ? "" : " ") + flag;
+
+    return res;
+}
+
+
+std::string EvalCache::make_key(const std::string& program_name, const std::string& baseline, const std::vector<std::string>& flags)
+{
+    std::string dataset;
+    std::string canonical = canonical_flags(flags, dataset);
+
+    return program_name + '\t' + get_compiler_version() + '\t' + baseline + '\t' + dataset + '\t' + canonical;
+}
+
+
+double EvalCache::get_runtime(const std::string& compile_string, const std::string& program_name, const std::string& baseline, const std::vector<std::string>& flags, const std::string& exec_location)
+{
+    std::string key = make_key(program_name, baseline, flags);
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        auto it = samples.find(key);
+        if((it != samples.end()) && (it->second.size() >= min_samples))
+        {
+            hits++;
+
+            double sum = 0;
+            for(double s : it->second)
+                sum += s;
+
+            return sum / it->second.size();
+        }
+
+        misses++;
+    }
+
+    // measured without holding the lock so other environments can compile at the same time
+    double runtime = run_given_string(compile_string, program_name, exec_location);
+
+    if(runtime < 0)
+        return runtime;
+
+    std::lock_guard<std::mutex> lock(mtx);
+
+    std::vector<double>& key_samples = samples[key];
+    key_samples.push_back(runtime);
+
+    if(out_file.is_open())
+        out_file << key << '\t' << runtime << std::endl;
+
+    double sum = 0;
+    for(double s : key_samples)
+        sum += s;
+
+    return sum / key_samples.size();
+}
+
+
+double EvalCache::get_runtime(PolyString* ps, bool unoptimised)
+{
+    if(unoptimised)
+        return get_runtime(ps->get_no_plugin_no_optimisations_PolyString(), ps->program_name, "-O0", {}, ps->exec_location);
+
+    return get_runtime(ps->get_no_plugin_PolyString(), ps->program_name, ps->optimisation_baseline, ps->optimisations, ps->exec_location);
+}
+
+
+void EvalCache::print_stats()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    unsigned long lookups = hits + misses;
+
+    std::cout << "Evaluation cache: " << hits << " hits, " << misses << " misses";
+    if(lookups > 0)
+        std::cout << " (" << (100.0 * hits / lookups) << "% hit rate)";
+    std::cout << ", " << samples.size() << " flag sets, " << num_loaded << " samples loaded from " << (filename.empty() ? "memory" : filename) << '\n';
+}
@@ -0,0 +1,128 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 16/06/2024
+ * FILE LAST UPDATED: 16/06/2024
+ *
+ * REQUIREMENTS: PolyBench, statetool
+ * REFERENCES:
+ *
+ * DESCRIPTION: Implementation file for the program state cache.
+*/
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+#include "utils/feature_cache.h"
+
+
+FeatureCache::FeatureCache(const std::string& filename)
+:
+    filename(filename),
+    hits(0),
+    misses(0),
+    num_loaded(0)
+{
+    if(filename.empty())
+        return;
+
+    load();
+
+    out_file.open(filename, std::ios::app);
+    if(!out_file.is_open())
+        std::cerr << "ERROR OPENING FEATURE CACHE, PROGRAM STATES WILL NOT BE SAVED: " << filename << '\n';
+
+    // states read back exactly as they were extracted
+    out_file.precision(17);
+
+    return;
+}
+
+
+void FeatureCache::load()
+{
+    std::ifstream in_file(filename);
+
+    // a cache that does not exist yet is created on the first state
+    if(!in_file.is_open())
+        return;
+
+    std::string line;
+    while(getline(in_file, line))
+    {
+        std::size_t sep = line.rfind('\t');
+        if((sep == std::string::npos) || (std::count(line.begin(), line.end(), '\t') != 5))
+            continue;
+
+        std::istringstream values(line.substr(sep + 1));
+        std::vector<double> st;
+
+        double v;
+        while(values >> v)
+            st.push_back(v);
+
+        if(st.empty() || !values.eof())
+            continue;
+
+        states[line.substr(0, sep)] = st;
+        num_loaded++;
+    }
+
+    return;
+}
+
+
+std::vector<double> FeatureCache::get_program_state(PolyString* ps, int num_features)
+{
+    std::string key = EvalCache::make_key(ps->program_name, ps->optimisation_baseline, ps->optimisations);
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        auto it = states.find(key);
+        if((it != states.end()) && (it->second.size() == num_features))
+        {
+            hits++;
+            return it->second;
+        }
+
+        misses++;
+    }
+
+    // extracted without holding the lock so other environments can compile at the same time
+    std::vector<double> st = ::get_program_state(ps, num_features);
+
+    if(st.size() != num_features)
+        return st;
+
+    std::lock_guard<std::mutex> lock(mtx);
+
+    states[key] = st;
+
+    if(out_file.is_open())
+    {
+        out_file << key << '\t';
+
+        int i;
+        for(i = 0; i < num_features; i++)
+            out_file << ((i > 0) ? " " : "") << st[i];
+
+        out_file << std::endl;
+    }
+
+    return st;
+}
+
+
+void FeatureCache::print_stats()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    unsigned long lookups = hits + misses;
+
+    std::cout << "Feature cache: " << hits << " hits, " << misses << " misses";
+    if(lookups > 0)
+        std::cout << " (" << (100.0 * hits / lookups) << "% hit rate)";
+    std::cout << ", " << states.size() << " states, " << num_loaded << " loaded from " << (filename.empty() ? "memory" : filename) << '\n';
+}
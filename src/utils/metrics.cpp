@@ -0,0 +1,175 @@
+
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include "utils/metrics.h"
+
+
+/* METRICS SINK */
+
+
+MetricsSink::MetricsSink(const std::string& filename, int capacity, int drain_ms)
+: head(0), tail(0), dropped(0), names_written(0), drain_ms(drain_ms), written(0), flush_requested(false), stopping(false)
+{
+    // power of two capacity so ring positions are a mask of the counters
+    uint64_t size = 1;
+    while(size < (uint64_t)std::max(capacity, 1))
+        size <<= 1;
+
+    ring.resize(size);
+    mask = size - 1;
+
+    ids_col.reserve(size);
+    steps_col.reserve(size);
+    values_col.reserve(size);
+
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if(!file.is_open())
+    {
+        std::cerr << "Could not open metrics log " << filename << "!\n";
+        return;
+    }
+
+    metrics_file_header_t header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, METRICS_MAGIC, sizeof(METRICS_MAGIC));
+    header.version = METRICS_VERSION;
+
+    file.write((const char*)&header, sizeof(header));
+    file.flush();
+
+    worker = std::thread(&MetricsSink::run, this);
+}
+
+
+MetricsSink::~MetricsSink()
+{
+    if(worker.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+
+        // the writer drains the ring once more before it exits
+        worker.join();
+    }
+
+    if(dropped > 0)
+        std::cerr << "Metrics log dropped " << dropped << " records, increase the sink capacity!\n";
+}
+
+
+int MetricsSink::register_metric(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    int i;
+    for(i = 0; i < names.size(); i++)
+        if(names[i] == name)
+            return i;
+
+    names.push_back(name);
+
+    return names.size() - 1;
+}
+
+
+void MetricsSink::flush()
+{
+    uint64_t target = head.load(std::memory_order_relaxed);
+
+    std::unique_lock<std::mutex> lock(mtx);
+
+    if(!worker.joinable())
+        return;
+
+    flush_requested = true;
+    cv.notify_all();
+
+    cv.wait(lock, [this, target]() { return written >= target; });
+}
+
+
+void MetricsSink::run()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+
+    while(true)
+    {
+        // woken early by flush and the destructor
+        cv.wait_for(lock, std::chrono::milliseconds(drain_ms), [this]() { return flush_requested || stopping; });
+
+        bool stop = stopping;
+        flush_requested = false;
+
+        lock.unlock();
+        drain();
+        lock.lock();
+
+        cv.notify_all();
+
+        if(stop)
+            break;
+    }
+}
+
+
+void MetricsSink::drain()
+{
+    // head before names, every id in the records read below was registered before they were recorded
+    uint64_t h = head.load(std::memory_order_acquire);
+    uint64_t t = tail.load(std::memory_order_relaxed);
+
+    std::vector<std::string> new_names;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        new_names.assign(names.begin() + names_written, names.end());
+    }
+
+    for(auto const& name : new_names)
+    {
+        metrics_block_header_t block = {METRICS_BLOCK_NAME, (uint32_t)name.size()};
+        uint32_t id = names_written++;
+
+        file.write((const char*)&block, sizeof(block));
+        file.write((const char*)&id, sizeof(id));
+        file.write(name.data(), name.size());
+    }
+
+    if(h != t)
+    {
+        ids_col.clear();
+        steps_col.clear();
+        values_col.clear();
+
+        uint64_t p;
+        for(p = t; p != h; p++)
+        {
+            const record_t& r = ring[p & mask];
+
+            ids_col.push_back(r.metric_id);
+            steps_col.push_back(r.step);
+            values_col.push_back(r.value);
+        }
+
+        // records are copied out, the producer can reuse their slots
+        tail.store(h, std::memory_order_release);
+
+        metrics_block_header_t block = {METRICS_BLOCK_DATA, (uint32_t)ids_col.size()};
+
+        file.write((const char*)&block, sizeof(block));
+        file.write((const char*)ids_col.data(), ids_col.size() * sizeof(uint32_t));
+        file.write((const char*)steps_col.data(), steps_col.size() * sizeof(uint64_t));
+        file.write((const char*)values_col.data(), values_col.size() * sizeof(double));
+    }
+
+    if(!new_names.empty() || (h != t))
+        file.flush();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    written = h;
+}
@@ -0,0 +1,132 @@
+/***
+ * AUTHOR: Harry Findlay
+ * LICENSE: Shipped with package - GNU GPL v3.0
+ * FILE START: 10/06/2024
+ * FILE LAST UPDATED: 10/06/2024
+ *
+ * REQUIREMENTS: POSIX (posix_spawn, wait4)
+ * REFERENCES:
+ *
+ * DESCRIPTION: Implementation file for running child processes without a shell.
+*/
+
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "utils/process.h"
+
+extern char** environ;
+
+
+std::vector<std::string> split_command(const std::string& command)
+{
+    std::vector<std::string> argv;
+    std::istringstream in(command);
+
+    std::string arg;
+    while(in >> arg)
+        argv.push_back(arg);
+
+    return argv;
+}
+
+
+bool run_process(const std::vector<std::string>& argv, process_result_t& result, bool capture_output)
+{
+    result = process_result_t();
+
+    if(argv.empty())
+    {
+        std::cerr << "ERROR: NO PROGRAM GIVEN TO RUN\n";
+        return false;
+    }
+
+    std::vector<char*> c_argv;
+    c_argv.reserve(argv.size() + 1);
+    for(auto const& a : argv)
+        c_argv.push_back(const_cast<char*>(a.c_str()));
+    c_argv.push_back(NULL);
+
+    int out_pipe[2] = {-1, -1};
+    if(capture_output && (pipe2(out_pipe, O_CLOEXEC) != 0))
+    {
+        std::cerr << "ERROR: COULD NOT CREATE OUTPUT PIPE FOR " << argv[0] << '\n';
+        return false;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+    // dup2 clears close on exec on the child's copy, the pipe ends themselves close on exec
+    if(capture_output)
+        posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+
+    pid_t pid;
+    int err = posix_spawnp(&pid, c_argv[0], &actions, NULL, c_argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if(capture_output)
+        close(out_pipe[1]);
+
+    if(err != 0)
+    {
+        std::cerr << "ERROR: COULD NOT START " << argv[0] << ": " << std::strerror(err) << '\n';
+
+        if(capture_output)
+            close(out_pipe[0]);
+
+        return false;
+    }
+
+    result.spawned = true;
+
+    // drained before waiting so a child filling the pipe never blocks
+    if(capture_output)
+    {
+        char buf[4096];
+        ssize_t n;
+        while(((n = read(out_pipe[0], buf, sizeof(buf))) > 0) || ((n < 0) && (errno == EINTR)))
+        {
+            if(n > 0)
+                result.output.append(buf, n);
+        }
+
+        close(out_pipe[0]);
+    }
+
+    int status;
+    struct rusage usage;
+    while(wait4(pid, &status, 0, &usage) < 0)
+    {
+        if(errno != EINTR)
+        {
+            std::cerr << "ERROR: LOST CHILD PROCESS " << argv[0] << '\n';
+            return false;
+        }
+    }
+
+    if(WIFEXITED(status))
+        result.exit_status = WEXITSTATUS(status);
+    else if(WIFSIGNALED(status))
+        result.term_signal = WTERMSIG(status);
+
+    result.user_time = usage.ru_utime.tv_sec + (usage.ru_utime.tv_usec * 1e-6);
+    result.sys_time = usage.ru_stime.tv_sec + (usage.ru_stime.tv_usec * 1e-6);
+    result.max_rss_kb = usage.ru_maxrss;
+
+    return result.succeeded();
+}
+
+
+bool run_command(const std::string& command, process_result_t& result, bool capture_output)
+{
+    return run_process(split_command(command), result, capture_output);
+}
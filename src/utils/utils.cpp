@@ -2,7 +2,7 @@
  * AUTHOR: Harry Findlay
  * LICENSE: Shipped with package - GNU GPL v3.0
  * FILE START: 14/03/2024
- * FILE LAST UPDATED: 25/04/2024
+ * FILE LAST UPDATED: 10/06/2024
  * 
  * REQUIREMENTS: PolyBench
  * REFERENCES:
@@ -11,6 +11,11 @@
 */
 
 
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include <unistd.h>
+
 #include "utils/utils.h"
 
 
@@ -18,17 +23,22 @@
 std::vector<std::string> benchmarks = read_file_to_vec(DEFAULT_BENCHMARKS_LIST_LOCATION);
 std::vector<std::string> optimisations = read_file_to_vec(DEFAULT_OPTIMISATIONS_LIST_LOCATION);
 
+/* TEMP FOLDERS ARE CREATED ONCE AT STARTUP RATHER THAN BEFORE EVERY COMPILE */
+bool tmp_folders_created = create_tmp_folders();
+
 
 /* PolyString ENVIRONMENT IMPLEMENTATION */
 
 
-PolyString::PolyString(const std::string &program_name, const std::string &plugin_info, const std::string &output, const std::string &baseline)
+PolyString::PolyString(const std::string &program_name, const std::string &plugin_info, const std::string &output, const std::string &baseline, const std::string &exec_location, const std::string &plugin_output_location)
 :
     program_name(program_name), 
     header(construct_header(program_name)),
     plugin_info(plugin_info), 
     output(output),
-    optimisation_baseline(baseline)
+    optimisation_baseline(baseline),
+    exec_location(exec_location),
+    plugin_output_location(plugin_output_location)
 { }
 
 void PolyString::reset_PolyString_optimisations() { optimisations.clear(); };
@@ -40,7 +50,7 @@ void PolyString::reset_PolyString_environment(const std::string &new_program_nam
 
     program_name = new_program_name;
     header = construct_header(new_program_name);
-    output = (get_benchmark_files(new_program_name) + "-DPOLYBENCH_TIME -o " + DEFAULT_EXEC_OUTPUT_LOCATION + new_program_name);
+    output = (get_benchmark_files(new_program_name) + "-DPOLYBENCH_TIME -o " + exec_location + new_program_name);
 
     return;
 }
@@ -53,7 +63,7 @@ std::string PolyString::get_full_PolyString()
     for (auto const &s : optimisations)
         res += (s + " ");
 
-    return res;
+    return res + get_polybench_object(optimisation_baseline);
 };
 
 
@@ -64,27 +74,52 @@ std::string PolyString::get_no_plugin_PolyString()
     for (auto const &s : optimisations)
         res += (s + " ");
 
-    return res;
+    return res + get_polybench_object(optimisation_baseline);
 }
 
 
 std::string PolyString::get_no_plugin_no_optimisations_PolyString()
 {
-    return header + " " + output + " -O0";
+    return header + " " + output + " -O0 " + get_polybench_object("-O0");
 };
 
 
 /* UTILS FUNCTION IMPLEMENTATIONS */
 
 
-PolyString* construct_polybench_PolyString(const std::string& program_name, const std::string& baseline)
+bool create_tmp_folders()
+{
+    bool created = true;
+
+    for(auto const& folder : {DEFAULT_EXEC_OUTPUT_LOCATION, "data/tmp", DEFAULT_POLYBENCH_OBJECT_LOCATION})
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(folder, ec);
+
+        if(ec)
+        {
+            std::cout << "ERROR: COULD NOT CREATE TEMP FOLDER " << folder << ": " << ec.message() << std::endl;
+            created = false;
+        }
+    }
+
+    return created;
+}
+
+
+PolyString* construct_polybench_PolyString(const std::string& program_name, const std::string& baseline, const std::string& scratch_dir)
 {
+    std::string exec_location(scratch_dir.empty() ? DEFAULT_EXEC_OUTPUT_LOCATION : scratch_dir);
+    std::string plugin_output_location(scratch_dir.empty() ? DEFAULT_PLUGIN_OUTPUT_LOCATION : (scratch_dir + DEFAULT_PLUGIN_OUTPUT_FILENAME));
+
     PolyString* new_ps = new PolyString
     (
         program_name,
-        DEFAULT_PLUGIN_INFO,
-        (get_benchmark_files(program_name) + "-DPOLYBENCH_TIME -o " + DEFAULT_EXEC_OUTPUT_LOCATION + program_name),
-        baseline
+        DEFAULT_PLUGIN_ARGS + plugin_output_location,
+        (get_benchmark_files(program_name) + "-DPOLYBENCH_TIME -o " + exec_location + program_name),
+        baseline,
+        exec_location,
+        plugin_output_location
     );
 
     return new_ps;
@@ -148,7 +183,7 @@ std::string format_benchmark_string(const std::string& benchmark_to_fmt)
         if(benchmarks[i][j] == '/')
             break;
 
-    benchmark_string.append(" -I " + benchmarks[i].substr(0, j) + " polybench-c-3.2/utilities/polybench.c ");
+    benchmark_string.append(" -I " + benchmarks[i].substr(0, j) + " ");
     benchmark_string.append(benchmarks[i] + " -DPOLYBENCH_TIME -o " + DEFAULT_EXEC_OUTPUT_LOCATION + benchmark_to_fmt);
 
     return benchmark_string;
@@ -182,44 +217,40 @@ int get_benchmark_location(const std::string& program_name)
 }
 
 
-double run_given_string(const std::string& compile_string, const std::string& program_name)
+double run_given_string(const std::string& compile_string, const std::string& program_name, const std::string& exec_location, process_result_t* run_result)
 {
-    // ensuring folders have been created
-    std::system("mkdir -p bin/tmp");
-    std::system("mkdir -p data/tmp");
+    process_result_t result;
 
     // compiling the program
-    std::system(compile_string.c_str());
+    if(!run_command(compile_string, result))
+    {
+        std::cout << "ERROR: DURING PROGRAM COMPILATION - CONTINUING" << std::endl;
+        return -1;
+    }
 
+    // running the program, polybench prints the execution time to stdout
+    const std::string exec_path(exec_location + program_name);
+    run_process({exec_path}, result, true);
 
-    // running the program
-    std::string exec_string((std::string)"./" + DEFAULT_EXEC_OUTPUT_LOCATION + program_name + (std::string)" > " + DEFAULT_DATA_OUTPUT_LOCATION);
-    std::system(exec_string.c_str());
+    if(run_result != NULL)
+        *run_result = result;
 
-    // extracting the program execution time and cleaning up
-    double res = -1;
-    std::ifstream output_file(DEFAULT_DATA_OUTPUT_LOCATION);
+    // delete executable
+    std::error_code ec;
+    std::filesystem::remove(exec_path, ec);
 
-    if(output_file.is_open())
-    {
-        std::string line;
-        while(getline(output_file, line))
-            res = std::stod(line);
-    }
-    else
+    // extracting the program execution time
+    if(!result.succeeded() || result.output.empty())
     {
         std::cout << "ERROR: DURING PROGRAM RUNTIME EXTRACTION - CONTINUING" << std::endl;
-        output_file.close();
         return -1;
     }
 
-    output_file.close();
-
-    // delete executable
-    std::system(((std::string) "rm -f " + DEFAULT_EXEC_OUTPUT_LOCATION + program_name).c_str());
-
-    // delete tmp data
-    std::system(((std::string)"rm " + DEFAULT_DATA_OUTPUT_LOCATION).c_str());
+    double res = -1;
+    std::istringstream output(result.output);
+    std::string line;
+    while(getline(output, line))
+        res = std::stod(line);
 
     return res;    
 }
@@ -231,17 +262,14 @@ std::vector<double> get_program_state(PolyString* ps, int num_features)
 
     /* ensure stateplugin has been built prior to running this function */
 
-    // creating temp folder
-    std::system("mkdir -p data/tmp");
-
-    std::string exec_string = ps->get_full_PolyString();
+    process_result_t result;
+    run_command(ps->get_full_PolyString(), result);
 
     // read state vector
-    std::system(exec_string.c_str());
-    std::vector<double> prog_state = read_state_vector(DEFAULT_PLUGIN_OUTPUT_LOCATION, num_features);
+    std::vector<double> prog_state = read_state_vector(ps->plugin_output_location, num_features);
 
     // remove tmp data
-    std::system(((std::string)"rm " + DEFAULT_PLUGIN_OUTPUT_LOCATION).c_str());
+    std::remove(ps->plugin_output_location.c_str());
 
     return prog_state;
 }
@@ -287,15 +315,15 @@ std::string opt_vec_to_string(const std::vector<std::string>& opts)
 bool check_unop_compile(const std::string& unop, const std::string& program_name)
 {
     // compile the program to location
-    std::system("mkdir -p bin/tmp");
-
-    std::system(unop.c_str());
+    process_result_t result;
+    bool compiled = run_command(unop, result);
 
     const std::filesystem::path unop_path{DEFAULT_EXEC_OUTPUT_LOCATION + program_name};
-    bool res = std::filesystem::exists(unop_path);
+    bool res = compiled && std::filesystem::exists(unop_path);
 
     // removing temp program
-    std::system(((std::string)"rm " + DEFAULT_EXEC_OUTPUT_LOCATION + program_name).c_str());
+    std::error_code ec;
+    std::filesystem::remove(unop_path, ec);
 
     return res;
 }
@@ -322,5 +350,70 @@ std::string construct_header(const std::string& program_name)
 std::string get_benchmark_files(const std::string& program_name)
 {
     int pos = get_benchmark_location(program_name);
-    return ("polybench-c-3.2/utilities/polybench.c " + benchmarks[pos] + " "); 
+    return (benchmarks[pos] + " "); 
+}
+
+
+std::string get_polybench_object(const std::string& baseline)
+{
+    static std::mutex mtx;
+    static std::map<std::string, std::string> objects;
+
+    // environments of a pool ask concurrently, only one builds
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto it = objects.find(baseline);
+    if(it != objects.end())
+        return it->second;
+
+    // FNV-1a of the configuration names the object so each compiler and baseline gets its own
+    uint64_t hash = 14695981039346656037ULL;
+    for(unsigned char c : (get_compiler_version() + '\t' + baseline))
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "polybench_%016llx.o", (unsigned long long)hash);
+    std::string object_path(DEFAULT_POLYBENCH_OBJECT_LOCATION + (std::string)name);
+
+    std::error_code ec;
+    bool up_to_date = std::filesystem::exists(object_path, ec) && (std::filesystem::last_write_time(object_path, ec) >= std::filesystem::last_write_time(POLYBENCH_UTILITIES_SOURCE, ec)) && !ec;
+
+    if(!up_to_date)
+    {
+        // built under a temporary name and renamed so another process never links a partly written object
+        std::string tmp_path(object_path + ".tmp" + std::to_string(getpid()));
+        std::string compile_string(POLY_COMPILER + (std::string)" -I polybench-c-3.2/utilities -DPOLYBENCH_TIME -c " + POLYBENCH_UTILITIES_SOURCE + " " + baseline + " -o " + tmp_path);
+
+        process_result_t result;
+        if(!run_command(compile_string, result))
+        {
+            std::cout << "ERROR: COULD NOT PREBUILD POLYBENCH UTILITIES - COMPILING THEM WITH EVERY PROGRAM" << std::endl;
+            std::filesystem::remove(tmp_path, ec);
+
+            objects[baseline] = POLYBENCH_UTILITIES_SOURCE;
+            return objects[baseline];
+        }
+
+        std::filesystem::rename(tmp_path, object_path, ec);
+    }
+
+    objects[baseline] = object_path;
+    return object_path;
+}
+
+
+const std::string& get_compiler_version()
+{
+    static const std::string compiler_version = []() {
+        process_result_t result;
+        run_process({POLY_COMPILER, "--version"}, result, true);
+
+        std::string version = result.output.substr(0, result.output.find('\n'));
+        return version.empty() ? (std::string)POLY_COMPILER " (unknown version)" : version;
+    }();
+
+    return compiler_version;
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+"""
+Reader for the binary training metrics log written by MetricsSink (include/utils/metrics.h).
+
+    from metrics_reader import read_metrics
+    metrics = read_metrics("data/training/train_metrics.bin")
+    metrics["loss"]   # DataFrame with columns step, value
+"""
+
+import struct
+
+import numpy as np
+import pandas as pd
+
+METRICS_MAGIC = b"DRLGCCM\0"
+METRICS_VERSION = 1
+
+METRICS_BLOCK_NAME = 0
+METRICS_BLOCK_DATA = 1
+
+
+def read_metrics(filename):
+    """Return a dict of metric name -> DataFrame(step, value), in the order values were recorded."""
+    with open(filename, "rb") as f:
+        data = f.read()
+
+    magic, version, _ = struct.unpack_from("<8sII", data, 0)
+    if magic != METRICS_MAGIC:
+        raise ValueError(filename + " is not a metrics log")
+    if version != METRICS_VERSION:
+        raise ValueError("unsupported metrics log version " + str(version))
+
+    names = {}
+    ids, steps, values = [], [], []
+
+    pos = 16
+    while pos + 8 <= len(data):
+        block_type, count = struct.unpack_from("<II", data, pos)
+        pos += 8
+
+        if block_type == METRICS_BLOCK_NAME:
+            if pos + 4 + count > len(data):
+                break
+            (metric_id,) = struct.unpack_from("<I", data, pos)
+            names[metric_id] = data[pos + 4:pos + 4 + count].decode()
+            pos += 4 + count
+        elif block_type == METRICS_BLOCK_DATA:
+            # a block cut short by a crash is dropped
+            if pos + count * 20 > len(data):
+                break
+            ids.append(np.frombuffer(data, dtype="<u4", count=count, offset=pos))
+            steps.append(np.frombuffer(data, dtype="<u8", count=count, offset=pos + 4 * count))
+            values.append(np.frombuffer(data, dtype="<f8", count=count, offset=pos + 12 * count))
+            pos += 20 * count
+        else:
+            raise ValueError("corrupt metrics log, unknown block type " + str(block_type))
+
+    ids = np.concatenate(ids) if ids else np.zeros(0, dtype="<u4")
+    steps = np.concatenate(steps) if steps else np.zeros(0, dtype="<u8")
+    values = np.concatenate(values) if values else np.zeros(0, dtype="<f8")
+
+    return {name: pd.DataFrame({"step": steps[ids == metric_id], "value": values[ids == metric_id]})
+            for metric_id, name in names.items()}